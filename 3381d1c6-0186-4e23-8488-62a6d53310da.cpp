@@ -2,11 +2,52 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <memory_resource>
 #include <algorithm>
 #include <queue>
+#include <set>
 #include <random>
 #include <chrono>
 #include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <climits>
+#include <cmath>
+#include <array>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <functional>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <type_traits>
+#include <typeinfo>
+#include <new>
+#include <exception>
+#include <variant>
+#include <optional>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <string_view>
+#ifdef _WIN32
+#define LAB_NO_MMAP 1
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LAB_SIMD_SSE2 1
+#endif
+#ifndef LAB_STATS
+#define LAB_STATS 1 // -DLAB_STATS=0 compiles the hot-path probes out
+#endif
 using namespace std;
 
 /*
@@ -14,41 +55,807 @@ using namespace std;
   : Skill Trees + Characters
 */
 
+/* --------------------- Allocation counting (benchmark support) ---------------------
+   Global operator new bumps a per-thread counter so benchmarks can report allocations/op.
+   Array and nothrow forms forward here; over-aligned allocations are not counted.
+*/
+inline uint64_t& threadAllocations() {
+    thread_local uint64_t count = 0;
+    return count;
+}
+void* operator new(size_t size) {
+    threadAllocations()++;
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete" // malloc/free pairing is intentional here
+#endif
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+/* --------------------- Stats (per-thread hot-path counters and latency histograms) ---------------------
+   LAB_PROBE(X) at the top of a hot function counts the call in the calling thread's own block and
+   times every sampleEvery-th call into a log2 nanosecond histogram, so the common path is a
+   thread_local lookup and two relaxed stores. Stats::snapshot() merges the live blocks with those
+   of threads that already exited; toJson()/toText() dump it. Build with -DLAB_STATS=0 and every
+   probe compiles to nothing (snapshots then read all zeros).
+*/
+class Stats {
+    struct Counters;
+    struct Block;
+public:
+    enum Probe : uint8_t {
+        SIM_TURN, ATTACK, USE_SKILL, SKILL_APPLY, TREE_LOOKUP, INVENTORY_ADD, INVENTORY_FIND, INVENTORY_REMOVE,
+        PROBE_COUNT
+    };
+    static constexpr size_t buckets = 40;        // bucket i: [2^i, 2^(i+1)) ns, bucket 0 also holds 0
+    static constexpr uint32_t sampleEvery = 16;  // power of two
+
+    static const char* name(Probe p) {
+        static const char* const names[PROBE_COUNT] = {
+            "sim_turn", "attack", "use_skill", "skill_apply", "tree_lookup", "inventory_add", "inventory_find", "inventory_remove"
+        };
+        return names[p];
+    }
+
+    struct Totals {
+        uint64_t count = 0;
+        uint64_t sampled = 0;   // timed calls
+        uint64_t sampledNs = 0;
+        uint64_t histogram[buckets] = {};
+
+        double meanNs() const { return sampled ? double(sampledNs) / sampled : 0.0; }
+        // upper edge of the bucket holding quantile q of the timed calls
+        double percentileNs(double q) const {
+            uint64_t rank = uint64_t(q * double(sampled)), seen = 0;
+            for (size_t i = 0;i < buckets;i++)
+                if ((seen += histogram[i]) > rank) return double(uint64_t(1) << (i + 1));
+            return 0.0;
+        }
+    };
+
+    struct Snapshot {
+        Totals probes[PROBE_COUNT];
+        uint32_t threads = 0; // blocks merged, live and retired
+
+        string toJson() const {
+            ostringstream os;
+            os << "{\"enabled\":" << (LAB_STATS ? "true" : "false") << ",\"threads\":" << threads << ",\"sample_every\":" << sampleEvery << ",\"probes\":{";
+            for (size_t p = 0;p < PROBE_COUNT;p++) {
+                const Totals& t = probes[p];
+                os << (p ? "," : "") << "\"" << name(Probe(p)) << "\":{\"count\":" << t.count << ",\"sampled\":" << t.sampled
+                    << ",\"mean_ns\":" << t.meanNs() << ",\"p50_ns\":" << t.percentileNs(0.5) << ",\"p99_ns\":" << t.percentileNs(0.99) << ",\"histogram\":[";
+                size_t last = buckets;
+                while (last > 0 && !t.histogram[last - 1]) last--;
+                for (size_t i = 0;i < last;i++) os << (i ? "," : "") << t.histogram[i];
+                os << "]}";
+            }
+            os << "}}";
+            return os.str();
+        }
+        string toText() const {
+            ostringstream os;
+            os << "hot-path stats (" << threads << " thread(s), 1/" << sampleEvery << " calls timed" << (LAB_STATS ? "" : ", compiled out") << ")\n";
+            for (size_t p = 0;p < PROBE_COUNT;p++) {
+                const Totals& t = probes[p];
+                os << "  " << left << setw(18) << name(Probe(p)) << right << setw(12) << t.count << " calls";
+                if (t.sampled) os << "  mean " << fixed << setprecision(1) << t.meanNs() << " ns  p50 <" << t.percentileNs(0.5)
+                    << " ns  p99 <" << t.percentileNs(0.99) << " ns" << defaultfloat;
+                os << "\n";
+            }
+            return os.str();
+        }
+    };
+
+    // counts one call; times it when it falls on the sampling stride
+    class Scope {
+        Block* block;
+        Probe probe;
+        bool timed;
+        chrono::steady_clock::time_point t0;
+    public:
+        explicit Scope(Probe p) : block(&local()), probe(p) {
+            bump(block->counters[p].count, 1);
+            timed = (++block->tick[p] & (sampleEvery - 1)) == 0;
+            if (timed) t0 = chrono::steady_clock::now();
+        }
+        ~Scope() {
+            if (!timed) return;
+            uint64_t ns = uint64_t(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count());
+            Counters& c = block->counters[probe];
+            bump(c.sampled, 1);
+            bump(c.sampledNs, ns);
+            size_t b = 0;
+            while (b + 1 < buckets && (ns >> (b + 1))) b++;
+            bump(c.histogram[b], 1);
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    static Snapshot snapshot() {
+        Snapshot s;
+        Registry& r = registry();
+        lock_guard<mutex> lock(r.lock);
+        for (Block* b : r.live) add(s, *b);
+        add(s, r.retired);
+        s.threads = uint32_t(r.live.size()) + r.retiredThreads;
+        return s;
+    }
+    // zeroes every block; calls racing with it on other threads may keep a few counts
+    static void reset() {
+        Registry& r = registry();
+        lock_guard<mutex> lock(r.lock);
+        for (Block* b : r.live) clear(*b);
+        clear(r.retired);
+        r.retiredThreads = 0;
+    }
+
+private:
+    struct Counters {
+        atomic<uint64_t> count{ 0 }, sampled{ 0 }, sampledNs{ 0 };
+        atomic<uint64_t> histogram[buckets] = {};
+    };
+    struct Block {
+        Counters counters[PROBE_COUNT];
+        uint32_t tick[PROBE_COUNT] = {}; // owner thread only
+    };
+    struct Registry {
+        mutex lock;
+        vector<Block*> live;
+        Block retired; // folded blocks of exited threads
+        uint32_t retiredThreads = 0;
+    };
+    // registers the thread's block on first use and folds it into `retired` when the thread exits
+    struct Owner {
+        Block block;
+        Owner() {
+            Registry& r = registry();
+            lock_guard<mutex> lock(r.lock);
+            r.live.push_back(&block);
+        }
+        ~Owner() {
+            Registry& r = registry();
+            lock_guard<mutex> lock(r.lock);
+            fold(r.retired, block);
+            r.retiredThreads++;
+            r.live.erase(find(r.live.begin(), r.live.end(), &block));
+        }
+    };
+
+    static Registry& registry() {
+        static Registry r;
+        return r;
+    }
+    static Block& local() {
+        thread_local Owner owner;
+        return owner.block;
+    }
+    // single writer per block: a relaxed load + store is enough and avoids a locked add
+    static void bump(atomic<uint64_t>& v, uint64_t by) { v.store(v.load(memory_order_relaxed) + by, memory_order_relaxed); }
+
+    static void fold(Block& into, const Block& from) {
+        for (size_t p = 0;p < PROBE_COUNT;p++) {
+            Counters& d = into.counters[p];
+            const Counters& s = from.counters[p];
+            d.count.fetch_add(s.count.load(memory_order_relaxed), memory_order_relaxed);
+            d.sampled.fetch_add(s.sampled.load(memory_order_relaxed), memory_order_relaxed);
+            d.sampledNs.fetch_add(s.sampledNs.load(memory_order_relaxed), memory_order_relaxed);
+            for (size_t i = 0;i < buckets;i++) d.histogram[i].fetch_add(s.histogram[i].load(memory_order_relaxed), memory_order_relaxed);
+        }
+    }
+    static void add(Snapshot& s, const Block& b) {
+        for (size_t p = 0;p < PROBE_COUNT;p++) {
+            Totals& t = s.probes[p];
+            const Counters& c = b.counters[p];
+            t.count += c.count.load(memory_order_relaxed);
+            t.sampled += c.sampled.load(memory_order_relaxed);
+            t.sampledNs += c.sampledNs.load(memory_order_relaxed);
+            for (size_t i = 0;i < buckets;i++) t.histogram[i] += c.histogram[i].load(memory_order_relaxed);
+        }
+    }
+    static void clear(Block& b) {
+        for (auto& c : b.counters) {
+            c.count.store(0, memory_order_relaxed);
+            c.sampled.store(0, memory_order_relaxed);
+            c.sampledNs.store(0, memory_order_relaxed);
+            for (auto& h : c.histogram) h.store(0, memory_order_relaxed);
+        }
+    }
+};
+
+#if LAB_STATS
+#define LAB_PROBE(probe) Stats::Scope labProbeScope(Stats::probe)
+#else
+#define LAB_PROBE(probe) ((void)0)
+#endif
+
 /* --------------------- Logger --------------------- */
+struct LogEvent;
+
 class Logger {
 public:
-    enum Level { INFO, WARN, ERROR };
-private:
+    enum Level { INFO, WARN, ERROR, OFF }; // OFF silences everything (batch workers)
+protected:
     Level level;
+    ostream* out;
 public:
-    Logger(Level l = INFO) : level(l) {}
-    void log(const string& msg, Level l = INFO) {
-        if (l >= level) {
-            cout << "[" << levelName(l) << "] " << msg << "\n";
+    Logger(Level l = INFO, ostream& os = cout) : level(l), out(&os) {}
+    virtual ~Logger() = default;
+
+    bool enabled(Level l) const { return l >= level; }
+
+    virtual void log(const string& msg, Level l = INFO) {
+        if (enabled(l)) {
+            *out << "[" << levelName(l) << "] " << msg << "\n";
         }
     }
-    static string levelName(Level l) {
+    // structured event; the synchronous backend formats it straight away
+    virtual void record(const LogEvent& e);
+
+    // lazy variant for hot paths: make() builds the event only when the level passes the filter
+    template<typename F>
+    void emit(Level l, F&& make) {
+        if (enabled(l)) record(make());
+    }
+
+    static const char* levelName(Level l) {
         switch (l) {
         case INFO: return "INFO";
         case WARN: return "WARN";
-        default: return "ERROR";
+        case ERROR: return "ERROR";
+        case OFF: return "OFF";
+        }
+        return "?";
+    }
+};
+
+/* --------------------- LogEvent (structured, fixed-size, no heap for short names) ---------------------
+   Names are copied into an inline buffer so an event can outlive the objects it talks about;
+   text that does not fit spills to the heap instead of being cut. The text is only produced
+   when a sink writes it out.
+*/
+struct LogEvent {
+    enum Kind : uint8_t {
+        TEXT, ATTACK, RAGE_BONUS, CRITICAL, USE_SKILL, INVALID_SKILL, EQUIP_SKILL,
+        LEVEL_UP, SHOUT, DODGE, CAST, NO_MANA, ADD_MEMBER, SKILL_HIT, PASSIVE_BUFF, ULTIMATE_HIT
+    };
+    static constexpr size_t inlineCap = 96;
+
+    Kind kind;
+    Logger::Level level;
+    int value;
+
+    LogEvent() : kind(TEXT), level(Logger::INFO), value(0) {}
+    LogEvent(Kind k, Logger::Level l, string_view actor = string_view(), string_view subject = string_view(),
+        string_view object = string_view(), int v = 0) : kind(k), level(l), value(v) {
+        setFields({ actor, subject, object });
+    }
+    static LogEvent text(Logger::Level l, const char* msg, size_t len) {
+        LogEvent e(TEXT, l);
+        e.setFields({ string_view(msg, len) });
+        return e;
+    }
+    static LogEvent text(Logger::Level l, const char* msg) { return text(l, msg, strlen(msg)); }
+
+    string_view actor() const { return field(0); }   // TEXT: the message
+    string_view subject() const { return field(1); } // skill / target
+    string_view object() const { return field(2); }  // target
+    string_view message() const { return field(0); }
+
+    // reproduces the exact wording of the original string-concatenating call sites
+    void write(ostream& os) const {
+        switch (kind) {
+        case TEXT: os << message(); break;
+        case ATTACK: os << actor() << " attacks " << object() << " for " << value << " dmg."; break;
+        case RAGE_BONUS: os << actor() << " uses RAGE bonus for " << value << " extra dmg!"; break;
+        case CRITICAL: os << actor() << " lands a CRITICAL hit!"; break;
+        case USE_SKILL: os << actor() << " uses " << subject() << " on " << object(); break;
+        case INVALID_SKILL: os << actor() << " tried to use invalid skill index."; break;
+        case EQUIP_SKILL: os << actor() << " equips skill " << subject(); break;
+        case LEVEL_UP: os << actor() << " leveled up to " << value; break;
+        case SHOUT: os << actor() << " shouts and increases attack!"; break;
+        case DODGE: os << actor() << " prepares to dodge, defense increased temporarily."; break;
+        case CAST: os << actor() << " casts " << subject() << " costing " << value << " mana."; break;
+        case NO_MANA: os << actor() << " doesn't have enough mana (" << value << ") to cast " << subject(); break;
+        case ADD_MEMBER: os << "Adding member " << actor(); break;
+        case SKILL_HIT: os << "ActiveSkill " << subject() << " applied to " << object() << " for " << value << " damage"; break;
+        case PASSIVE_BUFF: os << "PassiveSkill " << subject() << " applied to " << object() << " (passive buff)"; break;
+        case ULTIMATE_HIT: os << "UltimateSkill " << subject() << " strikes " << object() << " for " << value << " massive damage!"; break;
+        }
+    }
+
+private:
+    uint32_t lengths[3] = { 0, 0, 0 };
+    char text_[inlineCap];
+    string spill; // all fields, back to back, when they do not fit in text_ (stays empty otherwise)
+
+    const char* storage() const { return spill.empty() ? text_ : spill.data(); }
+    string_view field(size_t i) const {
+        size_t offset = 0;
+        for (size_t k = 0;k < i;k++) offset += lengths[k];
+        return string_view(storage() + offset, lengths[i]);
+    }
+    void setFields(initializer_list<string_view> fields) {
+        size_t total = 0, i = 0;
+        for (string_view f : fields) total += f.size();
+        char* dst = text_;
+        if (total > inlineCap) {
+            spill.resize(total);
+            dst = &spill[0];
+        }
+        for (string_view f : fields) {
+            if (f.size() > UINT32_MAX) throw length_error("LogEvent: field too long");
+            if (!f.empty()) memcpy(dst, f.data(), f.size());
+            dst += f.size();
+            lengths[i++] = uint32_t(f.size());
+        }
+    }
+};
+
+inline void Logger::record(const LogEvent& e) {
+    if (!enabled(e.level)) return;
+    *out << "[" << levelName(e.level) << "] ";
+    e.write(*out);
+    *out << "\n";
+}
+
+/* --------------------- AsyncLogger (per-thread lock-free rings + background drain) ---------------------
+   Producers push into their own single-producer/single-consumer ring (registered once per thread),
+   so the hot path is two atomic loads and a store. A background thread drains every ring into the sink
+   without holding the registration lock, so a slow sink never blocks a new producer. A full ring
+   drops the event and counts it instead of blocking the game loop.
+*/
+class AsyncLogger : public Logger {
+public:
+    using Sink = function<void(const LogEvent&)>;
+
+private:
+    struct Ring;
+    // rings a thread writes to, by logger id; a dying logger removes its entries from every thread's list
+    struct ThreadRings {
+        mutex m;
+        vector<pair<uint64_t, Ring*>> owned;
+    };
+    struct Ring {
+        static constexpr size_t capacity = 4096; // power of two
+        alignas(64) atomic<size_t> head{ 0 };    // next slot to write (producer)
+        alignas(64) atomic<size_t> tail{ 0 };    // next slot to read (drainer)
+        atomic<uint64_t> dropped{ 0 };
+        unique_ptr<LogEvent[]> slots{ new LogEvent[capacity] };
+        weak_ptr<ThreadRings> owner; // expires when the producer thread exits
+    };
+
+    static uint64_t nextId() {
+        static atomic<uint64_t> counter{ 0 };
+        return ++counter;
+    }
+
+    const uint64_t id;
+    Sink sink;
+    mutex ringsMutex; // guards registration only
+    vector<unique_ptr<Ring>> rings;
+    vector<Ring*> draining; // drainer's copy of `rings`
+    atomic<bool> stopping{ false };
+    thread drainer;
+
+public:
+    explicit AsyncLogger(Level l = INFO, Sink s = Sink()) : Logger(l), id(nextId()), sink(move(s)) {
+        if (!sink) sink = [this](const LogEvent& e) { Logger::record(e); };
+        drainer = thread([this] { drainLoop(); });
+    }
+    AsyncLogger(Level l, ostream& os) : AsyncLogger(l) { out = &os; }
+    ~AsyncLogger() override {
+        stopping.store(true, memory_order_release);
+        drainer.join();
+        lock_guard<mutex> g(ringsMutex);
+        for (auto& r : rings) {
+            shared_ptr<ThreadRings> t = r->owner.lock();
+            if (!t) continue;
+            lock_guard<mutex> tg(t->m);
+            auto& owned = t->owned;
+            owned.erase(remove_if(owned.begin(), owned.end(), [&](const pair<uint64_t, Ring*>& o) { return o.first == id; }), owned.end());
+        }
+    }
+
+    void record(const LogEvent& e) override {
+        if (!enabled(e.level)) return;
+        Ring& r = localRing();
+        size_t h = r.head.load(memory_order_relaxed);
+        if (h - r.tail.load(memory_order_acquire) >= Ring::capacity) {
+            r.dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        r.slots[h & (Ring::capacity - 1)] = e;
+        r.head.store(h + 1, memory_order_release);
+    }
+    void log(const string& msg, Level l = INFO) override {
+        if (enabled(l)) record(LogEvent::text(l, msg.data(), msg.size()));
+    }
+
+    // blocks until everything recorded so far has reached the sink
+    void flush() {
+        for (;;) {
+            bool empty = true;
+            {
+                lock_guard<mutex> g(ringsMutex);
+                for (auto& r : rings)
+                    if (r->tail.load(memory_order_acquire) != r->head.load(memory_order_acquire)) empty = false;
+            }
+            if (empty) return;
+            this_thread::yield();
+        }
+    }
+    uint64_t droppedCount() {
+        lock_guard<mutex> g(ringsMutex);
+        uint64_t n = 0;
+        for (auto& r : rings) n += r->dropped.load(memory_order_relaxed);
+        return n;
+    }
+
+private:
+    static shared_ptr<ThreadRings>& threadRings() {
+        thread_local shared_ptr<ThreadRings> t = make_shared<ThreadRings>();
+        return t;
+    }
+
+    Ring& localRing() {
+        // ids are never reused, so a slot left behind by a destroyed logger can never match
+        thread_local pair<uint64_t, Ring*> last{ 0, nullptr };
+        if (last.first == id) return *last.second;
+        shared_ptr<ThreadRings>& mine = threadRings();
+        {
+            lock_guard<mutex> tg(mine->m);
+            for (auto& o : mine->owned)
+                if (o.first == id) return *(last = o).second;
+        }
+        lock_guard<mutex> g(ringsMutex);
+        rings.push_back(make_unique<Ring>());
+        Ring* r = rings.back().get();
+        r->owner = mine;
+        lock_guard<mutex> tg(mine->m);
+        mine->owned.emplace_back(id, r);
+        last = { id, r };
+        return *r;
+    }
+
+    size_t drainOnce() {
+        size_t n = 0;
+        {
+            lock_guard<mutex> g(ringsMutex);
+            if (draining.size() != rings.size()) { // rings are only ever appended
+                draining.clear();
+                for (auto& r : rings) draining.push_back(r.get());
+            }
+        }
+        for (Ring* r : draining) {
+            size_t t = r->tail.load(memory_order_relaxed);
+            size_t h = r->head.load(memory_order_acquire);
+            for (; t != h; ++t, ++n) sink(r->slots[t & (Ring::capacity - 1)]);
+            r->tail.store(t, memory_order_release);
+        }
+        return n;
+    }
+
+    void drainLoop() {
+        while (!stopping.load(memory_order_acquire)) {
+            if (drainOnce() == 0) this_thread::sleep_for(chrono::microseconds(200));
+        }
+        drainOnce();
+    }
+};
+
+/* --------------------- Random source (pluggable, counter-based) ---------------------
+   Combat code draws through rollRand(), which reads the RandomSource installed for the current
+   thread. CounterRng is the standard source: roll i of a stream is a pure hash of (key, i), so
+   streams keyed by (seed, stream) are independent, any position is reachable in O(1), and
+   parallel runs reproduce bit for bit without shared state. A thread that installs nothing
+   draws from its own CounterRng keyed by the process seed (seedRandom) and a thread number.
+*/
+// derives an independent 64-bit seed for stream `stream` of `seed` (splitmix64 finalizer)
+inline uint64_t mixSeed(uint64_t seed, uint64_t stream) {
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull * (stream + 1);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+class RandomSource {
+public:
+    virtual ~RandomSource() = default;
+    virtual int roll() = 0; // uniform in [0, 2^31), the range callers of rand() expect
+    // bulk mode: the same values as n consecutive roll() calls
+    virtual void fill(int* out, size_t n) { for (size_t i = 0;i < n;i++) out[i] = roll(); }
+    // n rolls reduced to [0, bound): variance rolls (level + 3), crit rolls (100), ...
+    void fillBelow(int* out, size_t n, int bound) {
+        fill(out, n);
+        for (size_t i = 0;i < n;i++) out[i] %= bound;
+    }
+};
+
+class CounterRng final : public RandomSource {
+    uint64_t key;
+    uint64_t counter = 0;
+public:
+    explicit CounterRng(uint64_t seed, uint64_t stream = 0) : key(mixSeed(seed, stream)) {}
+
+    uint64_t next64() { return mixSeed(key, counter++); }
+    int roll() override { return static_cast<int>(next64() >> 33); }
+    void fill(int* out, size_t n) override {
+        for (size_t i = 0;i < n;i++) out[i] = static_cast<int>(mixSeed(key, counter + i) >> 33);
+        counter += n;
+    }
+
+    uint64_t position() const { return counter; }
+    void seek(uint64_t pos) { counter = pos; }
+    // child stream, independent of this one and of its other children
+    CounterRng split(uint64_t stream) const { return CounterRng(key, stream); }
+
+    // UniformRandomBitGenerator, so <random> distributions can draw from it
+    using result_type = uint32_t;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT32_MAX; }
+    result_type operator()() { return static_cast<result_type>(next64() >> 32); }
+};
+
+// any standard engine (mt19937, minstd_rand, ...) behind the same interface
+template<typename Engine>
+class EngineSource final : public RandomSource {
+    Engine engine;
+public:
+    explicit EngineSource(typename Engine::result_type seed) : engine(seed) {}
+    int roll() override { return static_cast<int>(uniform_int_distribution<int>(0, INT_MAX)(engine)); }
+};
+
+inline RandomSource*& threadRng() {
+    thread_local RandomSource* rng = nullptr;
+    return rng;
+}
+
+inline atomic<uint64_t>& processSeed() {
+    static atomic<uint64_t> seed{ 1 };
+    return seed;
+}
+inline uint64_t threadStreamId() {
+    static atomic<uint64_t> nextId{ 0 };
+    thread_local uint64_t id = nextId.fetch_add(1);
+    return id;
+}
+inline CounterRng& defaultThreadRng() {
+    thread_local CounterRng rng(processSeed().load(), threadStreamId());
+    return rng;
+}
+// replaces srand(): reseeds this thread now and every thread that has not drawn yet
+inline void seedRandom(uint64_t seed) {
+    processSeed().store(seed);
+    defaultThreadRng() = CounterRng(seed, threadStreamId());
+}
+
+inline RandomSource& currentRandom() {
+    RandomSource* rng = threadRng();
+    return rng ? *rng : defaultThreadRng();
+}
+inline int rollRand() { return currentRandom().roll(); }
+
+// installs an existing source for the current thread until the scope ends
+class RandomScope {
+    RandomSource* previous;
+public:
+    explicit RandomScope(RandomSource& rng) : previous(threadRng()) { threadRng() = &rng; }
+    ~RandomScope() { threadRng() = previous; }
+    RandomScope(const RandomScope&) = delete;
+    RandomScope& operator=(const RandomScope&) = delete;
+};
+
+// installs a CounterRng keyed by a 64-bit seed for the current thread until the scope ends
+class SeededRngScope {
+    CounterRng rng;
+    RandomSource* previous;
+public:
+    explicit SeededRngScope(uint64_t seed) : rng(seed), previous(threadRng()) { threadRng() = &rng; }
+    ~SeededRngScope() { threadRng() = previous; }
+    SeededRngScope(const SeededRngScope&) = delete;
+    SeededRngScope& operator=(const SeededRngScope&) = delete;
+};
+
+/* --------------------- Symbols (interned names) ---------------------
+   Skill, item and character names are interned once into a process-wide table and stored as
+   32-bit ids: equality is an integer compare, hashing is the id, and getName() returns a
+   string_view into the table instead of a copy. Names hash to one of 64 shards, each a map under
+   its own reader-writer lock: looking up or re-interning a known name takes a shared lock on its
+   shard, so threads that resolve names concurrently do not serialize; only a new name locks its
+   shard exclusively, plus the insert mutex that appends its text and slot. Reading a name takes
+   no lock: an id's slot is written before `count` is published past it. Interned text lives
+   until exit.
+*/
+class SymbolTable {
+public:
+    using Id = uint32_t;
+    static constexpr Id none = UINT32_MAX;
+private:
+    static constexpr size_t pageBits = 12, pageSize = size_t(1) << pageBits, maxPages = 4096; // 16M names
+    static constexpr size_t chunkSize = 64 * 1024, shardCount = 64;
+
+    // the hash picks the shard and is kept for the shard's map, so a name is hashed once
+    struct Key {
+        string_view text;
+        size_t hash;
+        bool operator==(const Key& o) const { return hash == o.hash && text == o.text; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const noexcept { return k.hash; }
+    };
+
+    struct alignas(64) Shard {
+        mutable shared_mutex m;
+        unordered_map<Key, Id, KeyHash> ids; // keys point into chunks
+
+        Id find(const Key& k) const {
+            auto it = ids.find(k);
+            return it == ids.end() ? none : it->second;
+        }
+    };
+
+    array<Shard, shardCount> shards;
+    array<atomic<string_view*>, maxPages> pages{};
+    atomic<Id> count{ 0 };
+    // new names only (under their shard's exclusive lock): text, slots and ids in insertion order
+    mutable mutex insertMutex;
+    vector<unique_ptr<string_view[]>> ownedPages;
+    vector<unique_ptr<char[]>> chunks;
+    size_t chunkUsed = chunkSize;
+    size_t textBytes = 0;
+
+    static Key keyOf(string_view s) { return { s, hash<string_view>()(s) }; }
+    // top bits: the map's bucket index uses the low ones
+    static size_t shardIndex(const Key& k) { return (k.hash >> 32) % shardCount; }
+
+    string_view store(string_view s) {
+        if (s.empty()) return string_view();
+        if (s.size() > chunkSize / 4) { // long names get a chunk of their own
+            chunks.emplace_back(new char[s.size()]);
+            memcpy(chunks.back().get(), s.data(), s.size());
+            return string_view(chunks.back().get(), s.size());
+        }
+        if (chunkUsed + s.size() > chunkSize) {
+            chunks.emplace_back(new char[chunkSize]);
+            chunkUsed = 0;
+        }
+        char* p = chunks.back().get() + chunkUsed;
+        memcpy(p, s.data(), s.size());
+        chunkUsed += s.size();
+        return string_view(p, s.size());
+    }
+    // stores the text and gives it the next id
+    pair<Id, string_view> insert(string_view s) {
+        lock_guard<mutex> lock(insertMutex);
+        Id id = count.load(memory_order_relaxed);
+        if (id == maxPages * pageSize) throw bad_alloc(); // id space exhausted
+        string_view text = store(s);
+        size_t page = id >> pageBits;
+        if (!pages[page].load(memory_order_relaxed)) {
+            ownedPages.emplace_back(new string_view[pageSize]);
+            pages[page].store(ownedPages.back().get(), memory_order_release);
+        }
+        pages[page].load(memory_order_relaxed)[id & (pageSize - 1)] = text;
+        textBytes += s.size();
+        count.store(id + 1, memory_order_release);
+        return { id, text };
+    }
+public:
+    SymbolTable() { intern(string_view()); } // id 0 is the empty name
+
+    static SymbolTable& global() {
+        static SymbolTable table;
+        return table;
+    }
+
+    Id intern(string_view s) {
+        Key key = keyOf(s);
+        Shard& shard = shards[shardIndex(key)];
+        {
+            shared_lock<shared_mutex> lock(shard.m);
+            Id id = shard.find(key);
+            if (id != none) return id;
         }
+        unique_lock<shared_mutex> lock(shard.m);
+        Id id = shard.find(key); // another thread may have inserted it in between
+        if (id != none) return id;
+        auto [fresh, text] = insert(s);
+        shard.ids.emplace(Key{ text, key.hash }, fresh);
+        return fresh;
+    }
+    // id of an already interned name, or none (never inserts)
+    Id find(string_view s) const {
+        Key key = keyOf(s);
+        const Shard& shard = shards[shardIndex(key)];
+        shared_lock<shared_mutex> lock(shard.m);
+        return shard.find(key);
+    }
+    // empty for none and for ids the table never handed out
+    string_view name(Id id) const {
+        if (id >= count.load(memory_order_acquire)) return string_view();
+        return pages[id >> pageBits].load(memory_order_relaxed)[id & (pageSize - 1)];
+    }
+
+    size_t size() const { return count.load(memory_order_relaxed); }
+    // text + slot + hash-map bytes (approximate for the map)
+    size_t memoryBytes() const {
+        lock_guard<mutex> lock(insertMutex);
+        return textBytes + ownedPages.size() * pageSize * sizeof(string_view) + count * (sizeof(Key) + sizeof(Id) + 2 * sizeof(void*));
     }
 };
 
+class Symbol {
+    SymbolTable::Id id = 0;
+    explicit Symbol(SymbolTable::Id i, int) : id(i) {}
+public:
+    Symbol() = default;
+    // interns: the text stays in the table until exit. Use lookup() to resolve a name without inserting it
+    explicit Symbol(string_view s) : id(SymbolTable::global().intern(s)) {}
+
+    // symbol of an already interned name; valid() is false if the name was never interned
+    static Symbol lookup(string_view s) { return Symbol(SymbolTable::global().find(s), 0); }
+
+    bool valid() const { return id != SymbolTable::none; }
+    SymbolTable::Id value() const { return id; }
+    string_view view() const { return SymbolTable::global().name(id); }
+    string str() const { return string(view()); }
+    bool operator==(Symbol o) const { return id == o.id; }
+    bool operator!=(Symbol o) const { return id != o.id; }
+};
+
+namespace std {
+    template<> struct hash<Symbol> {
+        size_t operator()(Symbol s) const noexcept { return s.value(); }
+    };
+}
+
+// name parameter of skill, character and item constructors: creating a named object is where its
+// text is meant to be interned, so these accept text as well as a Symbol; nothing else converts
+class Name {
+    Symbol sym;
+public:
+    Name(Symbol s) : sym(s) {}
+    Name(string_view s) : sym(s) {}
+    Name(const string& s) : sym(s) {}
+    Name(const char* s) : sym(s) {}
+    operator Symbol() const { return sym; }
+};
+
 /* --------------------- Item (helper) --------------------- */
 class Item {
-    string name;
+    Symbol name;
     int value;
 public:
-    Item(string n = "", int v = 0) : name(n), value(v) {}
-    string getName() const { return name; }
+    Item(Name n = Symbol(), int v = 0) : name(n), value(v) {}
+    string_view getName() const { return name.view(); }
+    Symbol getSymbol() const { return name; }
     int getValue() const { return value; }
     string str() const {
-        return name + "($" + to_string(value) + ")";
+        return name.str() + "($" + to_string(value) + ")";
     }
 };
 
+// read-only view of contiguous storage (C++17 has no std::span)
+template<typename T>
+class ConstSpan {
+    const T* first;
+    size_t count;
+public:
+    ConstSpan(const T* p = nullptr, size_t n = 0) : first(p), count(n) {}
+    const T* begin() const { return first; }
+    const T* end() const { return first + count; }
+    const T& operator[](size_t i) const { return first[i]; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+};
+
 /* --------------------- Inventory (template - static polymorphism example #1) ---------------------
    Generic container for items (demonstrates template-based polymorphism at compile-time).
 */
@@ -59,22 +866,30 @@ class Inventory {
 public:
     Inventory(size_t cap = 10) : capacity(cap) {}
     bool add(const T& it) {
+        LAB_PROBE(INVENTORY_ADD);
         if (items.size() >= capacity) return false;
         items.push_back(it);
         return true;
     }
-    bool removeIfName(const string& n) {
-        auto it = remove_if(items.begin(), items.end(), [&](const T& it) { return it.getName() == n; });
+    // names compare as symbol ids; a name that was never interned cannot match
+    bool removeIfName(string_view n) { return removeIfSymbol(Symbol::lookup(n)); }
+    bool removeIfSymbol(Symbol n) {
+        LAB_PROBE(INVENTORY_REMOVE);
+        auto it = remove_if(items.begin(), items.end(), [&](const T& it) { return it.getSymbol() == n; });
         if (it == items.end()) return false;
         items.erase(it, items.end());
         return true;
     }
-    T* findByName(const string& n) {
+    T* findByName(string_view n) { return findBySymbol(Symbol::lookup(n)); }
+    T* findBySymbol(Symbol n) {
+        LAB_PROBE(INVENTORY_FIND);
         for (auto& it : items)
-            if (it.getName() == n) return &it;
+            if (it.getSymbol() == n) return &it;
         return nullptr;
     }
     vector<T> snapshot() const { return items; } // copy
+    ConstSpan<T> view() const { return ConstSpan<T>(items.data(), items.size()); } // no copy; invalidated by mutation
+    size_t getCapacity() const { return capacity; }
     string toString() const {
         string s = "Inventory(" + to_string(items.size()) + "/" + to_string(capacity) + "): ";
         for (auto& it : items) s += it.str() + " ";
@@ -82,133 +897,686 @@ public:
     }
 };
 
-/* --------------------- Forward declarations --------------------- */
-class Character;
-class Skill;
+/* --------------------- IndexedInventory (merchant / loot scale) ---------------------
+   Same item type as Inventory<T> (anything with getSymbol() and getValue()), for inventories of
+   thousands of items. Items stay contiguous (removal swaps the last item into the hole) and two
+   indexes follow them: name -> positions for O(1) lookup, and an ordered (value, position) set
+   for top-K and value-range queries. Views borrow the storage and are invalidated by mutation.
+*/
+template<typename T>
+class IndexedInventory {
+    vector<T> items;
+    size_t capacity;
+    unordered_multimap<Symbol, uint32_t> byName;
+    set<pair<int, uint32_t>> byValue;
 
-/* --------------------- Skill hierarchy (dynamic polymorphism) --------------------- */
-class Skill {
-protected:
-    string name;
-    int level;          // level of skill
-    int basePower;
 public:
-    Skill(const string& n, int p = 10) : name(n), level(1), basePower(p) {}
-    virtual ~Skill() = default;
-    virtual int effectivePower() const {
-        // non-trivial: computed from basePower and level
-        return basePower + level * 3;
-    }
-    virtual string description() const {
-        return name + " (lvl " + to_string(level) + ", pwr " + to_string(effectivePower()) + ")";
+    // ascending (value, position) range, yielding items
+    class ValueRange {
+        using It = typename set<pair<int, uint32_t>>::const_iterator;
+        const vector<T>* items;
+        It first, last;
+    public:
+        class iterator {
+            const vector<T>* items;
+            It it;
+        public:
+            iterator(const vector<T>* v, It i) : items(v), it(i) {}
+            const T& operator*() const { return (*items)[it->second]; }
+            const T* operator->() const { return &(*items)[it->second]; }
+            iterator& operator++() { ++it; return *this; }
+            bool operator!=(const iterator& o) const { return it != o.it; }
+        };
+        ValueRange(const vector<T>* v, It f, It l) : items(v), first(f), last(l) {}
+        iterator begin() const { return iterator(items, first); }
+        iterator end() const { return iterator(items, last); }
+        bool empty() const { return first == last; }
+    };
+
+    IndexedInventory(size_t cap = 10) : capacity(cap) {}
+
+    bool add(const T& it) { return addBatch(&it, 1) == 1; }
+
+    // adds as many of [first, first + n) as fit; capacity is checked once per batch
+    size_t addBatch(const T* first, size_t n) {
+        LAB_PROBE(INVENTORY_ADD);
+        n = min(n, capacity - min(capacity, items.size()));
+        items.reserve(items.size() + n);
+        byName.reserve(items.size() + n);
+        for (size_t i = 0;i < n;i++) {
+            uint32_t pos = uint32_t(items.size());
+            items.push_back(first[i]);
+            byName.emplace(first[i].getSymbol(), pos);
+            byValue.emplace(first[i].getValue(), pos);
+        }
+        return n;
     }
-    virtual void apply(Character& target) = 0; // abstract action on target
-    virtual void upgrade() {
-        level++;
-        basePower = basePower + 2;
+
+    // any item with that name, O(1) average
+    const T* findByName(string_view n) const { return findBySymbol(Symbol::lookup(n)); }
+    const T* findBySymbol(Symbol n) const {
+        LAB_PROBE(INVENTORY_FIND);
+        auto it = byName.find(n);
+        return it == byName.end() ? nullptr : &items[it->second];
     }
-    string getName() const { return name; }
-};
+    size_t countByName(Symbol n) const { return byName.count(n); }
 
-class ActiveSkill : public Skill {
-    int manaCost;
-public:
-    ActiveSkill(const string& n, int p = 12, int cost = 10) : Skill(n, p), manaCost(cost) {}
-    int effectivePower() const override {
-        // active skill gains more per level
-        return basePower + level * 5;
+    // removes every item with that name
+    bool removeIfName(string_view n) { return removeIfSymbol(Symbol::lookup(n)); }
+    bool removeIfSymbol(Symbol n) {
+        LAB_PROBE(INVENTORY_REMOVE);
+        bool removed = false;
+        for (auto it = byName.find(n); it != byName.end(); it = byName.find(n)) {
+            erase(it->second);
+            removed = true;
+        }
+        return removed;
     }
-    string description() const override {
-        return "Active: " + Skill::description() + " mana:" + to_string(manaCost);
+
+    // removes every item whose name is in [first, first + n); one compaction pass, indexes rebuilt once
+    size_t removeBatch(const Symbol* first, size_t n) {
+        LAB_PROBE(INVENTORY_REMOVE);
+        unordered_set<Symbol> doomed(first, first + n);
+        size_t before = items.size();
+        items.erase(remove_if(items.begin(), items.end(), [&](const T& it) { return doomed.count(it.getSymbol()) != 0; }), items.end());
+        if (items.size() != before) reindex();
+        return before - items.size();
     }
-    void apply(Character& target) override;
-};
 
-class PassiveSkill : public Skill {
-    double modifier; // e.g., increases defense or attack by percentage
-public:
-    PassiveSkill(const string& n, int p = 5, double mod = 0.05) : Skill(n, p), modifier(mod) {}
-    int effectivePower() const override {
-        // passive skill contributes moderately
-        return basePower + static_cast<int>(level * (modifier * 100));
+    // the k most valuable items, most valuable first (ties: later position first)
+    template<typename F>
+    void topByValue(size_t k, F f) const {
+        for (auto it = byValue.rbegin(); it != byValue.rend() && k > 0; ++it, --k) f(items[it->second]);
     }
-    string description() const override {
-        return "Passive: " + Skill::description() + " mod: " + to_string(modifier);
+    // items with lo <= value <= hi, ascending by value
+    ValueRange byValueRange(int lo, int hi) const {
+        auto first = byValue.lower_bound({ lo, 0 });
+        auto last = byValue.upper_bound({ hi, UINT32_MAX });
+        if (lo > hi) last = first;
+        return ValueRange(&items, first, last);
     }
-    void apply(Character& target) override; // will modify stats passively
-};
 
-class UltimateSkill : public ActiveSkill {
-    int cooldown;
-public:
-    UltimateSkill(const string& n, int p = 30, int cost = 30, int cd = 3) : ActiveSkill(n, p, cost), cooldown(cd) {}
-    int effectivePower() const override {
-        // very strong scaling
-        return basePower + level * 12;
+    ConstSpan<T> view() const { return ConstSpan<T>(items.data(), items.size()); }
+    size_t size() const { return items.size(); }
+    size_t getCapacity() const { return capacity; }
+
+private:
+    // moves the last item into pos and fixes both indexes for it
+    void erase(uint32_t pos) {
+        unindex(pos);
+        uint32_t last = uint32_t(items.size() - 1);
+        if (pos != last) {
+            unindex(last);
+            items[pos] = move(items[last]);
+            byName.emplace(items[pos].getSymbol(), pos);
+            byValue.emplace(items[pos].getValue(), pos);
+        }
+        items.pop_back();
     }
-    string description() const override {
-        return "Ultimate: " + Skill::description() + " cd:" + to_string(cooldown);
+    void unindex(uint32_t pos) {
+        auto range = byName.equal_range(items[pos].getSymbol());
+        for (auto it = range.first; it != range.second; ++it)
+            if (it->second == pos) { byName.erase(it); break; }
+        byValue.erase({ items[pos].getValue(), pos });
+    }
+    void reindex() {
+        byName.clear();
+        byValue.clear();
+        for (uint32_t i = 0;i < items.size();i++) {
+            byName.emplace(items[i].getSymbol(), i);
+            byValue.emplace(items[i].getValue(), i);
+        }
     }
-    void apply(Character& target) override;
 };
 
-/* --------------------- SkillTree node (non-template, nodes hold Skill*) --------------------- */
-class SkillTreeNode {
-    Skill* skill;
-    SkillTreeNode* parent;
-    vector<unique_ptr<SkillTreeNode>> children;
+/* --------------------- Arena (bump allocator, bulk release) ---------------------
+   Objects are placement-constructed into large chunks; nothing is freed individually.
+   Non-trivial destructors are recorded and run (in reverse order) when the arena dies,
+   then every chunk is released at once.
+*/
+class Arena {
+    static constexpr size_t chunkSize = 64 * 1024;
+    struct Dtor { void* obj; void (*destroy)(void*); };
+    vector<unique_ptr<unsigned char[]>> chunks;
+    size_t used = chunkSize; // forces a chunk on first allocation
+    size_t capacity = chunkSize;
+    vector<Dtor> dtors;
 public:
-    SkillTreeNode(Skill* s = nullptr, SkillTreeNode* p = nullptr) : skill(s), parent(p) {}
-    ~SkillTreeNode() { /* skill ownership is external (managed elsewhere) */ }
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() { release(); }
 
-    Skill* getSkill() const { return skill; }
-    SkillTreeNode* getParent() const { return parent; }
+    void* allocate(size_t size, size_t align) {
+        uintptr_t base = chunks.empty() ? 0 : reinterpret_cast<uintptr_t>(chunks.back().get());
+        size_t offset = alignUp(base + used, align) - base;
+        if (offset + size > capacity) {
+            capacity = max(chunkSize, size + align);
+            chunks.emplace_back(new unsigned char[capacity]);
+            base = reinterpret_cast<uintptr_t>(chunks.back().get());
+            offset = alignUp(base, align) - base;
+        }
+        used = offset + size;
+        return reinterpret_cast<void*>(base + offset);
+    }
 
-    // add child (creates ownership)
-    SkillTreeNode* addChild(Skill* s) {
-        children.push_back(make_unique<SkillTreeNode>(s, this));
-        return children.back().get();
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* p = new (allocate(sizeof(T), alignof(T))) T(forward<Args>(args)...);
+        if (!is_trivially_destructible<T>::value)
+            dtors.push_back({ p, [](void* o) { static_cast<T*>(o)->~T(); } });
+        return p;
     }
 
-    bool removeChildWithSkillName(const string& n) {
-        auto it = remove_if(children.begin(), children.end(),
-            [&](const unique_ptr<SkillTreeNode>& c) { return c->skill && c->skill->getName() == n; });
-        if (it == children.end()) return false;
-        children.erase(it, children.end());
+    size_t chunkCount() const { return chunks.size(); }
+
+    void release() {
+        for (auto it = dtors.rbegin(); it != dtors.rend(); ++it) it->destroy(it->obj);
+        dtors.clear();
+        chunks.clear();
+        used = capacity = chunkSize;
+    }
+
+private:
+    static uintptr_t alignUp(uintptr_t v, size_t align) { return (v + align - 1) & ~uintptr_t(align - 1); }
+};
+
+/* --------------------- ScratchArena (resettable pmr arena for temporaries) ---------------------
+   A monotonic pmr resource over one owned buffer, for per-battle and per-query scratch data
+   (descriptionsDFS(mem), getChildrenRaw(mem), ...). reset() drops everything at once; if the last
+   round spilled into the heap, the buffer is regrown past that high-water mark, so a workload of
+   steady size stops allocating after its first round. Unlike Arena it runs no destructors: it is
+   meant for pmr containers that are gone before reset().
+*/
+class ScratchArena {
+    // heap fallback that remembers how much it handed out since the last reset
+    class Spill : public pmr::memory_resource {
+    public:
+        size_t bytes = 0;
+    private:
+        void* do_allocate(size_t n, size_t align) override {
+            bytes += n + align;
+            return pmr::new_delete_resource()->allocate(n, align);
+        }
+        void do_deallocate(void* p, size_t n, size_t align) override { pmr::new_delete_resource()->deallocate(p, n, align); }
+        bool do_is_equal(const pmr::memory_resource& o) const noexcept override { return this == &o; }
+    };
+
+    size_t capacity;
+    unique_ptr<byte[]> buffer;
+    Spill spill;
+    optional<pmr::monotonic_buffer_resource> mono; // declared last: released before its buffers
+public:
+    explicit ScratchArena(size_t bytes = 64 * 1024) : capacity(bytes), buffer(new byte[bytes]) {
+        mono.emplace(buffer.get(), capacity, &spill);
+    }
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    pmr::memory_resource* resource() { return &*mono; }
+    operator pmr::memory_resource* () { return resource(); }
+
+    void reset() {
+        mono->release();
+        if (!spill.bytes) return;
+        capacity += spill.bytes;
+        spill.bytes = 0;
+        mono.reset();
+        buffer.reset(new byte[capacity]);
+        mono.emplace(buffer.get(), capacity, &spill);
+    }
+
+    size_t capacityBytes() const { return capacity; }
+    size_t spilledBytes() const { return spill.bytes; } // since the last reset
+};
+
+/* --------------------- MappedFile (read-only memory mapping) ---------------------
+   mmap on POSIX; elsewhere the file is read into memory once so callers see the same view.
+*/
+class MappedFile {
+    const unsigned char* base = nullptr;
+    size_t length = 0;
+#ifdef LAB_NO_MMAP
+    vector<unsigned char> copy;
+#endif
+public:
+    MappedFile() = default;
+    explicit MappedFile(const string& path) { open(path); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const string& path) {
+        close();
+#ifdef LAB_NO_MMAP
+        ifstream in(path, ios::binary);
+        if (!in) return false;
+        copy.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        base = copy.data();
+        length = copy.size();
+        return true;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) { ::close(fd); return false; }
+        void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        base = static_cast<const unsigned char*>(p);
+        length = size_t(st.st_size);
         return true;
+#endif
+    }
+    void close() {
+#ifdef LAB_NO_MMAP
+        copy.clear();
+#else
+        if (base) munmap(const_cast<unsigned char*>(base), length);
+#endif
+        base = nullptr;
+        length = 0;
     }
 
-    // depth-first traversal applying a function to each node (non-trivial)
-    template<typename F>
-    void dfs(F f) {
-        f(this);
-        for (auto& ch : children) ch->dfs(f);
+    const unsigned char* data() const { return base; }
+    size_t size() const { return length; }
+    bool isOpen() const { return base != nullptr; }
+};
+
+/* --------------------- Forward declarations --------------------- */
+class Character;
+class Skill;
+class SnapshotCodec; // binary save/load; befriended by the classes whose state it restores
+
+/* --------------------- Skill hierarchy (dynamic polymorphism) --------------------- */
+class Skill {
+    friend class SnapshotCodec;
+    friend class Character;
+    // the Character holding this skill, told when upgrade() changes its power. Never copied, so
+    // clones, arena copies and StaticSkill values start unowned
+    struct Owner {
+        Character* character = nullptr;
+        Owner() = default;
+        Owner(const Owner&) {}
+        Owner& operator=(const Owner&) { return *this; }
+    } owner;
+protected:
+    Symbol name;
+    int level;          // level of skill
+    int basePower;
+public:
+    Skill(Name n, int p = 10) : name(n), level(1), basePower(p) {}
+    virtual ~Skill() = default;
+    virtual int effectivePower() const {
+        // non-trivial: computed from basePower and level
+        return basePower + level * 3;
+    }
+    // snprintf-style: writes at most cap bytes (terminated) and returns the full length
+    virtual int describe(char* out, size_t cap) const { return describeAs(out, cap, "", effectivePower()); }
+    string description() const {
+        string s;
+        appendDescription(s);
+        return s;
+    }
+    // appends to any basic_string, e.g. a pmr::string backed by a ScratchArena
+    template<typename S>
+    void appendDescription(S& out) const { appendFormatted(out, [this](char* p, size_t cap) { return describe(p, cap); }); }
+
+    // runs an snprintf-style writer into a stack buffer, straight into `out` when it does not fit
+    template<typename S, typename W>
+    static void appendFormatted(S& out, W&& write) {
+        char buf[128];
+        int n = write(buf, sizeof(buf));
+        if (n <= 0) return;
+        if (size_t(n) < sizeof(buf)) { out.append(buf, size_t(n)); return; }
+        size_t at = out.size();
+        out.resize(at + size_t(n));
+        write(&out[at], size_t(n) + 1);
+    }
+    virtual void apply(Character& target) = 0; // abstract action on target
+    virtual unique_ptr<Skill> clone() const = 0; // deep copy (used when cloning characters)
+    virtual Skill* cloneInto(Arena& arena) const = 0; // deep copy owned by an arena
+    // raises level and power; an owning Character drops its cached power (defined after Character)
+    void upgrade();
+    // combat properties used by the timeline scheduler (passive skills are never cast)
+    virtual bool castable() const { return false; }
+    virtual int getManaCost() const { return 0; }
+    virtual int getCooldown() const { return 0; } // in the caster's own actions
+    string_view getName() const { return name.view(); }
+    Symbol getSymbol() const { return name; }
+
+protected:
+    int describeAs(char* out, size_t cap, const char* kind, int power) const {
+        string_view n = name.view();
+        return snprintf(out, cap, "%s%.*s (lvl %d, pwr %d)", kind, int(n.size()), n.data(), level, power);
+    }
+    // snprintf at out + used (clamped to cap); returns the new full length
+    template<typename... A>
+    static int appendf(char* out, size_t cap, int used, const char* fmt, A... args) {
+        size_t at = min(size_t(max(used, 0)), cap);
+        return used + snprintf(out + at, cap - at, fmt, args...);
+    }
+};
+
+class ActiveSkill : public Skill {
+    friend class SnapshotCodec;
+    int manaCost;
+public:
+    ActiveSkill(Name n, int p = 12, int cost = 10) : Skill(n, p), manaCost(cost) {}
+    int effectivePower() const override {
+        // active skill gains more per level
+        return basePower + level * 5;
+    }
+    bool castable() const override { return true; }
+    int getManaCost() const override { return manaCost; }
+    int describe(char* out, size_t cap) const override { return describeWith(out, cap, effectivePower()); }
+    // describe() for a known power, so StaticSkill can bind both calls at compile time
+    int describeWith(char* out, size_t cap, int power) const {
+        return appendf(out, cap, describeAs(out, cap, "Active: ", power), " mana:%d", manaCost);
+    }
+    void apply(Character& target) override;
+    unique_ptr<Skill> clone() const override { return unique_ptr<Skill>(new ActiveSkill(*this)); }
+    Skill* cloneInto(Arena& arena) const override { return arena.make<ActiveSkill>(*this); }
+};
+
+class PassiveSkill : public Skill {
+    friend class SnapshotCodec;
+    double modifier; // e.g., increases defense or attack by percentage
+public:
+    PassiveSkill(Name n, int p = 5, double mod = 0.05) : Skill(n, p), modifier(mod) {}
+    int effectivePower() const override {
+        // passive skill contributes moderately
+        return basePower + static_cast<int>(level * (modifier * 100));
+    }
+    int describe(char* out, size_t cap) const override { return describeWith(out, cap, effectivePower()); }
+    int describeWith(char* out, size_t cap, int power) const {
+        return appendf(out, cap, describeAs(out, cap, "Passive: ", power), " mod: %f", modifier); // %f: to_string(double)
+    }
+    void apply(Character& target) override; // will modify stats passively
+    unique_ptr<Skill> clone() const override { return unique_ptr<Skill>(new PassiveSkill(*this)); }
+    Skill* cloneInto(Arena& arena) const override { return arena.make<PassiveSkill>(*this); }
+};
+
+class UltimateSkill : public ActiveSkill {
+    friend class SnapshotCodec;
+    int cooldown;
+public:
+    UltimateSkill(Name n, int p = 30, int cost = 30, int cd = 3) : ActiveSkill(n, p, cost), cooldown(cd) {}
+    int effectivePower() const override {
+        // very strong scaling
+        return basePower + level * 12;
+    }
+    int getCooldown() const override { return cooldown; }
+    int describe(char* out, size_t cap) const override { return describeWith(out, cap, effectivePower()); }
+    int describeWith(char* out, size_t cap, int power) const {
+        return appendf(out, cap, describeAs(out, cap, "Ultimate: ", power), " cd:%d", cooldown);
+    }
+    void apply(Character& target) override;
+    unique_ptr<Skill> clone() const override { return unique_ptr<Skill>(new UltimateSkill(*this)); }
+    Skill* cloneInto(Arena& arena) const override { return arena.make<UltimateSkill>(*this); }
+};
+
+/* --------------------- SkillTree node (non-template, nodes hold Skill*) --------------------- */
+class SkillTreeNode;
+// skill name -> node; owned by the tree, shared by all of its nodes (multimap: names may repeat)
+using SkillNameIndex = unordered_multimap<Symbol, SkillTreeNode*>;
+
+class SkillTreeNode {
+    Skill* skill;
+    SkillTreeNode* parent;
+    vector<unique_ptr<SkillTreeNode>> children;
+    SkillNameIndex* index; // inherited from the parent, nullptr for a detached node
+public:
+    SkillTreeNode(Skill* s = nullptr, SkillTreeNode* p = nullptr) : skill(s), parent(p), index(p ? p->index : nullptr) {
+        addToIndex();
+    }
+    ~SkillTreeNode() { /* skill ownership is external (managed elsewhere) */ }
+
+    Skill* getSkill() const { return skill; }
+    SkillTreeNode* getParent() const { return parent; }
+
+    // called by the tree on its root; children pick the index up from their parent
+    void attachIndex(SkillNameIndex* idx) {
+        index = idx;
+        addToIndex();
+    }
+
+    // add child (creates ownership)
+    SkillTreeNode* addChild(Skill* s) {
+        children.push_back(make_unique<SkillTreeNode>(s, this));
+        return children.back().get();
     }
+    // takes over a detached subtree (built without an index, e.g. on another thread) and indexes it here
+    SkillTreeNode* adoptChild(unique_ptr<SkillTreeNode> sub) {
+        sub->parent = this;
+        children.push_back(move(sub));
+        SkillTreeNode* child = children.back().get();
+        child->dfs([&](SkillTreeNode* n) {
+            n->index = index;
+            n->addToIndex();
+            });
+        return child;
+    }
+
+    bool removeChildWithSkillName(string_view n) { return removeChildWithSymbol(Symbol::lookup(n)); }
+    bool removeChildWithSymbol(Symbol n) {
+        auto matches = [&](const unique_ptr<SkillTreeNode>& c) { return c->skill && c->skill->getSymbol() == n; };
+        // drop whole subtrees from the index before remove_if destroys them
+        if (index)
+            for (auto& c : children)
+                if (matches(c)) c->dfs([](SkillTreeNode* node) { node->removeFromIndex(); });
+        auto it = remove_if(children.begin(), children.end(), matches);
+        if (it == children.end()) return false;
+        children.erase(it, children.end());
+        return true;
+    }
+
+    // depth-first traversal applying a function to each node (non-trivial); lazy form: SkillTreeDfs
+    template<typename F>
+    void dfs(F f);
 
     vector<SkillTreeNode*> getChildrenRaw() {
         vector<SkillTreeNode*> out;
         for (auto& c : children) out.push_back(c.get());
         return out;
     }
+    pmr::vector<SkillTreeNode*> getChildrenRaw(pmr::memory_resource* mem) const {
+        pmr::vector<SkillTreeNode*> out(mem);
+        out.reserve(children.size());
+        for (auto& c : children) out.push_back(c.get());
+        return out;
+    }
+    size_t childCount() const { return children.size(); }
+    SkillTreeNode* child(size_t i) const { return children[i].get(); }
+
+    // true if a comes before b in a preorder walk of their common tree; O(depth + siblings)
+    static bool preorderBefore(const SkillTreeNode* a, const SkillTreeNode* b) {
+        if (a == b) return false;
+        auto depth = [](const SkillTreeNode* n) { size_t d = 0; for (;n->parent;n = n->parent) d++; return d; };
+        size_t da = depth(a), db = depth(b);
+        for (;da > db;da--) if ((a = a->parent) == b) return false; // b is an ancestor of a
+        for (;db > da;db--) if ((b = b->parent) == a) return true;  // a is an ancestor of b
+        while (a->parent != b->parent) { a = a->parent; b = b->parent; }
+        for (auto& c : a->parent->children) {
+            if (c.get() == a) return true;
+            if (c.get() == b) return false;
+        }
+        return false;
+    }
+
+private:
+    void addToIndex() {
+        if (index && skill) index->emplace(skill->getSymbol(), this);
+    }
+    void removeFromIndex() {
+        if (!index || !skill) return;
+        auto range = index->equal_range(skill->getSymbol());
+        for (auto it = range.first; it != range.second; ++it)
+            if (it->second == this) { index->erase(it); return; }
+    }
+};
+
+/* --------------------- SkillTree traversal (lazy, pull-based) ---------------------
+   SkillTreeDfs / SkillTreeBfs hand out one node per next() (or per step of a range-for), so a
+   caller can stop at any point without the rest of the tree being visited. Both keep only the
+   path from the root to the current node, O(depth) memory for any tree size. A prune predicate
+   (it must be pure: BFS asks it more than once per node) keeps a node but skips its descendants;
+   SkillTreeDfs can also skipChildren() of the node it just returned. BFS runs as iterative
+   deepening: pass k re-walks levels 0..k-1 to reach level k, about b/(b-1) times the work of a
+   queue on a b-ary tree (quadratic on a bare chain) but never a frontier of O(width) nodes.
+   describeNode() formats a description into a caller buffer, so streaming text costs nothing per
+   node; the path itself can come from a caller memory resource (a ScratchArena, a stack buffer).
+*/
+struct KeepAll {
+    bool operator()(const SkillTreeNode*) const { return false; }
+};
+
+// formats the node's skill description into buf (truncated to cap - 1 chars)
+inline string_view describeNode(const SkillTreeNode* n, char* buf, size_t cap) {
+    if (!n || !n->getSkill() || cap == 0) return string_view();
+    int len = n->getSkill()->describe(buf, cap);
+    return string_view(buf, len <= 0 ? 0 : min(size_t(len), cap - 1));
+}
+
+// input iterator over any walker with next()
+template<typename Walker>
+class WalkIterator {
+    Walker* walker;
+    SkillTreeNode* current;
+public:
+    WalkIterator(Walker* w, SkillTreeNode* c) : walker(w), current(c) {}
+    SkillTreeNode* operator*() const { return current; }
+    WalkIterator& operator++() { current = walker->next(); return *this; }
+    bool operator!=(const WalkIterator& o) const { return current != o.current; }
+};
+
+template<typename Prune = KeepAll>
+class SkillTreeDfs {
+    struct Frame {
+        SkillTreeNode* node;
+        size_t next; // next child to enter
+    };
+    SkillTreeNode* root;
+    Prune prune;
+    pmr::vector<Frame> path;
+    bool started = false;
+public:
+    explicit SkillTreeDfs(SkillTreeNode* r, Prune p = Prune(), pmr::memory_resource* mem = pmr::get_default_resource())
+        : root(r), prune(move(p)), path(mem) {}
+
+    // next node in preorder, nullptr once the walk is over
+    SkillTreeNode* next() {
+        if (!started) {
+            started = true;
+            return root ? enter(root) : nullptr;
+        }
+        while (!path.empty()) {
+            Frame& f = path.back();
+            if (f.next < f.node->childCount()) return enter(f.node->child(f.next++));
+            path.pop_back();
+        }
+        return nullptr;
+    }
+    // do not descend below the node last returned
+    void skipChildren() {
+        if (!path.empty()) path.back().next = path.back().node->childCount();
+    }
+    size_t depth() const { return path.empty() ? 0 : path.size() - 1; } // of the node last returned
+
+    WalkIterator<SkillTreeDfs> begin() { return WalkIterator<SkillTreeDfs>(this, next()); }
+    WalkIterator<SkillTreeDfs> end() { return WalkIterator<SkillTreeDfs>(this, nullptr); }
+
+private:
+    SkillTreeNode* enter(SkillTreeNode* n) {
+        path.push_back({ n, prune(n) ? n->childCount() : 0 });
+        return n;
+    }
 };
 
+template<typename Prune = KeepAll>
+class SkillTreeBfs {
+    struct Frame {
+        SkillTreeNode* node;
+        size_t next;
+    };
+    SkillTreeNode* root;
+    Prune prune;
+    pmr::vector<Frame> path;  // root .. parent of the level being produced
+    size_t level = 0;
+    bool started = false;
+    bool deeper = false; // some node of the current level has children to visit
+public:
+    explicit SkillTreeBfs(SkillTreeNode* r, Prune p = Prune(), pmr::memory_resource* mem = pmr::get_default_resource())
+        : root(r), prune(move(p)), path(mem) {}
+
+    // next node in level order (children left to right), nullptr once the walk is over
+    SkillTreeNode* next() {
+        if (!started) {
+            started = true;
+            if (!root) return nullptr;
+            deeper = expandable(root);
+            return root;
+        }
+        for (;;) {
+            if (path.empty()) { // start the pass for the next level
+                if (!deeper) return nullptr;
+                deeper = false;
+                level++;
+                path.push_back({ root, 0 });
+            }
+            while (!path.empty()) {
+                Frame& f = path.back();
+                if (f.next >= f.node->childCount()) { path.pop_back(); continue; }
+                SkillTreeNode* c = f.node->child(f.next++);
+                if (path.size() == level) { // c is on the level being produced
+                    deeper = deeper || expandable(c);
+                    return c;
+                }
+                if (!prune(c)) path.push_back({ c, 0 });
+            }
+        }
+    }
+    size_t depth() const { return level; } // of the node last returned
+
+    WalkIterator<SkillTreeBfs> begin() { return WalkIterator<SkillTreeBfs>(this, next()); }
+    WalkIterator<SkillTreeBfs> end() { return WalkIterator<SkillTreeBfs>(this, nullptr); }
+
+private:
+    bool expandable(SkillTreeNode* n) { return n->childCount() && !prune(n); }
+};
+
+// iterative, so deep trees cannot overflow the call stack; paths up to ~30 deep stay on the stack
+template<typename F>
+void SkillTreeNode::dfs(F f) {
+    alignas(max_align_t) byte local[1024];
+    pmr::monotonic_buffer_resource mem(local, sizeof(local));
+    SkillTreeDfs<> walk(this, KeepAll(), &mem);
+    while (SkillTreeNode* n = walk.next()) f(n);
+}
+
 /* --------------------- SkillTree template (static polymorphism example #2) ---------------------
    Generic skill tree template  demonstrates compile-time genericity.
    T is the stored "skill pointer" type (we will use Skill*).
 */
+struct TreeGenConfig;
+struct TreeGenResult;
+
 template<typename T>
 class SkillTree {
+    vector<unique_ptr<Arena>> arenas;  // skills built by generateParallel; freed with the nodes that use them
+    unique_ptr<SkillNameIndex> index; // heap-allocated so nodes keep a stable pointer when the tree moves (null once moved from)
     unique_ptr<SkillTreeNode> root;
 public:
-    SkillTree() : root(nullptr) {}
-    SkillTree(Skill* s) { root = make_unique<SkillTreeNode>(s, nullptr); }
+    SkillTree() : index(make_unique<SkillNameIndex>()), root(nullptr) {}
+    SkillTree(Skill* s) : SkillTree() { resetRoot(s); }
 
     SkillTreeNode* getRoot() const { return root.get(); }
+    size_t indexedCount() const { return index ? index->size() : 0; }
 
     // insert under parent skill name; returns pointer or nullptr
-    SkillTreeNode* insertUnder(const string& parentSkillName, Skill* s) {
+    SkillTreeNode* insertUnder(string_view parentSkillName, Skill* s) {
         if (!root) {
-            root = make_unique<SkillTreeNode>(s, nullptr);
+            resetRoot(s);
             return root.get();
         }
         SkillTreeNode* found = findNodeBySkillName(parentSkillName);
@@ -216,13 +1584,18 @@ public:
         return found->addChild(s);
     }
 
-    SkillTreeNode* findNodeBySkillName(const string& name) const {
-        if (!root) return nullptr;
-        SkillTreeNode* result = nullptr;
-        root->dfs([&](SkillTreeNode* node) {
-            if (node->getSkill() && node->getSkill()->getName() == name) result = node;
-            });
-        return result;
+    // O(1) average via the name index; a name that occurs more than once resolves to its last
+    // node in preorder, the node the original full-DFS search returned
+    SkillTreeNode* findNodeBySkillName(string_view name) const { return findNodeBySymbol(Symbol::lookup(name)); }
+    SkillTreeNode* findNodeBySymbol(Symbol name) const {
+        LAB_PROBE(TREE_LOOKUP);
+        if (!index) return nullptr;
+        auto range = index->equal_range(name);
+        if (range.first == range.second) return nullptr;
+        SkillTreeNode* found = range.first->second;
+        for (auto it = next(range.first); it != range.second; ++it)
+            if (SkillTreeNode::preorderBefore(found, it->second)) found = it->second;
+        return found;
     }
 
     // traverse and collect descriptions
@@ -234,12 +1607,47 @@ public:
             });
         return out;
     }
+    // lazy walks from the root (see SkillTreeDfs / SkillTreeBfs); O(depth) memory
+    template<typename Prune = KeepAll>
+    SkillTreeDfs<Prune> walkDfs(Prune prune = Prune(), pmr::memory_resource* mem = pmr::get_default_resource()) const {
+        return SkillTreeDfs<Prune>(root.get(), move(prune), mem);
+    }
+    template<typename Prune = KeepAll>
+    SkillTreeBfs<Prune> walkBfs(Prune prune = Prune(), pmr::memory_resource* mem = pmr::get_default_resource()) const {
+        return SkillTreeBfs<Prune>(root.get(), move(prune), mem);
+    }
+    // descriptionsDFS without the vector: each text is formatted into buf and handed to
+    // sink(string_view, node), which returns false to stop; returns the number of nodes visited
+    template<typename Sink>
+    size_t streamDescriptions(char* buf, size_t cap, Sink&& sink) const {
+        SkillTreeDfs<> walk(root.get());
+        size_t visited = 0;
+        while (SkillTreeNode* n = walk.next()) {
+            visited++;
+            if (n->getSkill() && !sink(describeNode(n, buf, cap), n)) break;
+        }
+        return visited;
+    }
+
+    // same text, every string and the vector allocated from `mem`
+    pmr::vector<pmr::string> descriptionsDFS(pmr::memory_resource* mem) const {
+        pmr::vector<pmr::string> out(mem);
+        if (!root) return out;
+        root->dfs([&](SkillTreeNode* node) {
+            if (node->getSkill()) node->getSkill()->appendDescription(out.emplace_back());
+            });
+        return out;
+    }
+
+    // many-core generation of large trees, identical for a seed at any thread count (see TreeShape)
+    TreeGenResult generateParallel(const TreeGenConfig& cfg);
 
     // generate simple random tree (non-trivial algorithm)
-    void generateRandom(Skill* (*skillFactory)(), int maxDepth = 3, int maxChildren = 3) {
+    // seed picks the tree shape; without one the clock is used (not reproducible)
+    void generateRandom(Skill* (*skillFactory)(), int maxDepth = 3, int maxChildren = 3, optional<unsigned> seed = nullopt) {
         // skillFactory() returns pointer to a newly allocated Skill
-        root = make_unique<SkillTreeNode>(skillFactory(), nullptr);
-        default_random_engine rng((unsigned)chrono::high_resolution_clock::now().time_since_epoch().count());
+        resetRoot(skillFactory());
+        default_random_engine rng(seed ? *seed : (unsigned)chrono::high_resolution_clock::now().time_since_epoch().count());
         // BFS-like expansion
         queue<pair<SkillTreeNode*, int>> q;
         q.push({ root.get(), 1 });
@@ -255,289 +1663,4969 @@ public:
             }
         }
     }
+
+    // replaces the tree with n nodes given in preorder (root first, parentAt(i) < i), the same
+    // contract as FlatSkillTree::assignPreorder; skillAt(arena, i) returns node i's skill (or null)
+    // and builds it in `arena`, which the tree keeps until it is reset, as for generateParallel
+    template<typename SkillAt, typename ParentAt>
+    void assignPreorder(size_t n, SkillAt skillAt, ParentAt parentAt) {
+        if (n == 0) {
+            clear();
+            return;
+        }
+        auto owned = make_unique<Arena>();
+        Arena& arena = *owned;
+        resetRoot(skillAt(arena, 0)); // releases the previous tree's arenas
+        arenas.push_back(move(owned));
+        vector<SkillTreeNode*> built(n);
+        built[0] = root.get();
+        for (size_t i = 1;i < n;i++) built[i] = built[parentAt(i)]->addChild(skillAt(arena, i));
+    }
+
+private:
+    void clear() {
+        root.reset();
+        arenas.clear();
+        if (!index) index = make_unique<SkillNameIndex>();
+        index->clear();
+    }
+
+    void resetRoot(Skill* s) {
+        clear();
+        root = make_unique<SkillTreeNode>(s, nullptr);
+        root->attachIndex(index.get());
+    }
 };
 
-/* --------------------- Character hierarchy --------------------- */
-class Character {
-protected:
-    string name;
-    int hp;
-    int mana;
-    int attackPower;
-    int defense;
-    int level;
-    vector<unique_ptr<Skill>> ownedSkills; // owns some skills
-    Inventory<Item> inventory; // composition of template Inventory
-    Logger& logger;
+/* --------------------- FlatSkillTree (arena-backed, index-linked layout) ---------------------
+   Same operations as SkillTree, but nodes are plain records in one contiguous vector addressed
+   by index, each node's children are a contiguous range of ids in a shared slot array, and
+   skills created by the tree live in its Arena. Traversal is an iterative preorder walk with
+   an explicit stack, so depth is not limited by the call stack. Removed subtrees are only
+   unlinked; their memory goes back in the single bulk release when the tree is destroyed.
+*/
+class FlatSkillTree {
+    friend class SnapshotCodec;
 public:
-    Character(const string& n, Logger& log)
-        : name(n), hp(100), mana(50), attackPower(10), defense(5), level(1), inventory(10), logger(log) {
+    using NodeId = uint32_t;
+    static constexpr NodeId npos = UINT32_MAX;
+
+    struct Node {
+        Skill* skill;
+        NodeId parent;
+        uint32_t firstChild;    // start of this node's range in childSlots
+        uint32_t childCount;
+        uint32_t childCapacity; // range is relocated to the end of childSlots when it fills up
+    };
+
+private:
+    Arena arena;          // owns skills created through emplaceUnder / generateRandom
+    vector<Node> nodes;
+    vector<NodeId> childSlots;
+    unordered_multimap<Symbol, NodeId> index;
+    NodeId root = npos;
+
+public:
+    FlatSkillTree() = default;
+    FlatSkillTree(Skill* s) { resetRoot(s); }
+
+    NodeId getRoot() const { return root; }
+    const Node& node(NodeId id) const { return nodes[id]; }
+    Skill* getSkill(NodeId id) const { return nodes[id].skill; }
+    NodeId getParent(NodeId id) const { return nodes[id].parent; }
+    size_t size() const { return index.size(); }
+
+    // children of id as a contiguous [begin, end) range of node ids
+    pair<const NodeId*, const NodeId*> children(NodeId id) const {
+        const NodeId* b = childSlots.data() + nodes[id].firstChild;
+        return { b, b + nodes[id].childCount };
+    }
+
+    // insert under parent skill name (skill stays externally owned, as in SkillTree); returns id or npos
+    NodeId insertUnder(string_view parentSkillName, Skill* s) {
+        if (root == npos) return resetRoot(s);
+        NodeId parent = findNodeBySkillName(parentSkillName);
+        if (parent == npos) return npos;
+        return addChild(parent, s);
+    }
+
+    // construct the skill inside the tree's arena and insert it
+    template<typename T, typename... Args>
+    NodeId emplaceUnder(string_view parentSkillName, Args&&... args) {
+        return insertUnder(parentSkillName, arena.make<T>(forward<Args>(args)...));
+    }
+
+    // construct a skill owned by this tree's arena (not linked anywhere yet)
+    template<typename T, typename... Args>
+    T* makeSkill(Args&&... args) { return arena.make<T>(forward<Args>(args)...); }
+
+    // replaces the tree with n nodes given in preorder (root first, parentAt(i) < i);
+    // every child range is sized exactly, so no slot relocation happens
+    template<typename SkillAt, typename ParentAt>
+    void assignPreorder(size_t n, SkillAt skillAt, ParentAt parentAt) {
+        clear();
+        if (n == 0) return;
+        vector<uint32_t> counts(n, 0);
+        for (size_t i = 1;i < n;i++) counts[parentAt(i)]++;
+        nodes.reserve(n);
+        index.reserve(n);
+        childSlots.resize(n - 1);
+        uint32_t next = 0;
+        for (size_t i = 0;i < n;i++) {
+            Skill* s = skillAt(i);
+            nodes.push_back({ s, i ? NodeId(parentAt(i)) : npos, next, 0, counts[i] });
+            next += counts[i];
+            if (s) index.emplace(s->getSymbol(), NodeId(i));
+        }
+        for (size_t i = 1;i < n;i++) {
+            Node& p = nodes[parentAt(i)];
+            childSlots[p.firstChild + p.childCount++] = NodeId(i);
+        }
+        root = 0;
+    }
+
+    NodeId addChild(NodeId parent, Skill* s) {
+        reserveChildren(parent, nodes[parent].childCount + 1);
+        NodeId id = newNode(s, parent);
+        Node& p = nodes[parent];
+        childSlots[p.firstChild + p.childCount++] = id;
+        return id;
+    }
+
+    NodeId findNodeBySkillName(string_view name) const { return findNodeBySymbol(Symbol::lookup(name)); }
+    // repeated names resolve to the last node in preorder, as in SkillTree
+    NodeId findNodeBySymbol(Symbol name) const {
+        LAB_PROBE(TREE_LOOKUP);
+        auto range = index.equal_range(name);
+        if (range.first == range.second) return npos;
+        NodeId found = range.first->second;
+        for (auto it = next(range.first); it != range.second; ++it)
+            if (preorderBefore(found, it->second)) found = it->second;
+        return found;
+    }
+
+    bool removeChildWithSkillName(NodeId parent, string_view n) { return removeChildWithSymbol(parent, Symbol::lookup(n)); }
+    bool removeChildWithSymbol(NodeId parent, Symbol n) {
+        Node& p = nodes[parent];
+        NodeId* slot = childSlots.data() + p.firstChild;
+        uint32_t kept = 0;
+        for (uint32_t i = 0;i < p.childCount;i++) {
+            NodeId c = slot[i];
+            if (nodes[c].skill && nodes[c].skill->getSymbol() == n) dfs(c, [&](NodeId d) { unindex(d); });
+            else slot[kept++] = c;
+        }
+        bool removed = kept != p.childCount;
+        p.childCount = kept;
+        return removed;
+    }
+
+    // iterative preorder traversal from `from` (whole tree by default)
+    template<typename F>
+    void dfs(NodeId from, F f, pmr::memory_resource* mem = pmr::get_default_resource()) const {
+        if (from == npos) return;
+        pmr::vector<NodeId> stack({ from }, mem);
+        while (!stack.empty()) {
+            NodeId id = stack.back();
+            stack.pop_back();
+            f(id);
+            auto [b, e] = children(id);
+            while (e != b) stack.push_back(*--e); // reversed so the first child is visited first
+        }
+    }
+    template<typename F>
+    void dfs(F f) const { dfs(root, f); }
+
+    vector<string> descriptionsDFS() const {
+        vector<string> out;
+        out.reserve(size());
+        dfs([&](NodeId id) {
+            if (nodes[id].skill) out.push_back(nodes[id].skill->description());
+            });
+        return out;
+    }
+    pmr::vector<pmr::string> descriptionsDFS(pmr::memory_resource* mem) const {
+        pmr::vector<pmr::string> out(mem);
+        out.reserve(size());
+        dfs(root, [&](NodeId id) {
+            if (nodes[id].skill) nodes[id].skill->appendDescription(out.emplace_back());
+            }, mem);
+        return out;
+    }
+
+    // same BFS expansion as SkillTree::generateRandom; skills end up owned by the arena
+    void generateRandom(Skill* (*skillFactory)(Arena&), int maxDepth = 3, int maxChildren = 3, optional<unsigned> seed = nullopt) {
+        generate([&] { return skillFactory(arena); }, maxDepth, maxChildren, seed);
+    }
+    // legacy heap factory: each skill is moved into the arena and the heap copy freed
+    void generateRandom(Skill* (*skillFactory)(), int maxDepth = 3, int maxChildren = 3, optional<unsigned> seed = nullopt) {
+        generate([&] {
+            unique_ptr<Skill> heap(skillFactory());
+            return heap->cloneInto(arena);
+            }, maxDepth, maxChildren, seed);
+    }
+
+private:
+    template<typename Make>
+    void generate(Make make, int maxDepth, int maxChildren, optional<unsigned> seed) {
+        clear();
+        resetRoot(make());
+        default_random_engine rng(seed ? *seed : (unsigned)chrono::high_resolution_clock::now().time_since_epoch().count());
+        queue<pair<NodeId, int>> q;
+        q.push({ root, 1 });
+        while (!q.empty()) {
+            auto [id, depth] = q.front(); q.pop();
+            if (depth >= maxDepth) continue;
+            uniform_int_distribution<int> distChildren(0, maxChildren);
+            int nc = distChildren(rng);
+            reserveChildren(id, nc); // exact-size range: siblings stay contiguous
+            for (int i = 0;i < nc;i++) q.push({ addChild(id, make()), depth + 1 });
+        }
+    }
+
+    bool preorderBefore(NodeId a, NodeId b) const {
+        if (a == b) return false;
+        auto depth = [&](NodeId n) { size_t d = 0; for (;nodes[n].parent != npos;n = nodes[n].parent) d++; return d; };
+        size_t da = depth(a), db = depth(b);
+        for (;da > db;da--) if ((a = nodes[a].parent) == b) return false;
+        for (;db > da;db--) if ((b = nodes[b].parent) == a) return true;
+        while (nodes[a].parent != nodes[b].parent) { a = nodes[a].parent; b = nodes[b].parent; }
+        for (auto [it, end] = children(nodes[a].parent); it != end; ++it) {
+            if (*it == a) return true;
+            if (*it == b) return false;
+        }
+        return false;
+    }
+
+    NodeId newNode(Skill* s, NodeId parent) {
+        NodeId id = static_cast<NodeId>(nodes.size());
+        nodes.push_back({ s, parent, static_cast<uint32_t>(childSlots.size()), 0, 0 });
+        if (s) index.emplace(s->getSymbol(), id);
+        return id;
+    }
+
+    void reserveChildren(NodeId id, uint32_t want) {
+        Node& n = nodes[id];
+        if (want <= n.childCapacity) return;
+        uint32_t cap = max(want, n.childCapacity * 2);
+        uint32_t start = static_cast<uint32_t>(childSlots.size());
+        if (n.firstChild + n.childCapacity == start) start = n.firstChild; // already last: grow in place
+        else for (uint32_t i = 0;i < n.childCount;i++) childSlots.push_back(childSlots[n.firstChild + i]);
+        childSlots.resize(start + cap);
+        n.firstChild = start;
+        n.childCapacity = cap;
+    }
+
+    void unindex(NodeId id) {
+        Skill* s = nodes[id].skill;
+        if (!s) return;
+        auto range = index.equal_range(s->getSymbol());
+        for (auto it = range.first; it != range.second; ++it)
+            if (it->second == id) { index.erase(it); return; }
+    }
+
+    NodeId resetRoot(Skill* s) {
+        nodes.clear();
+        childSlots.clear();
+        index.clear();
+        root = newNode(s, npos);
+        return root;
+    }
+
+    void clear() {
+        nodes.clear();
+        childSlots.clear();
+        index.clear();
+        root = npos;
+        arena.release();
+    }
+};
+
+/* --------------------- SkillTreeAggregates (Euler-tour range sums) ---------------------
+   Flattens a SkillTree in preorder, so every subtree is one contiguous range [tin, tout).
+   Two Fenwick trees over that order answer in O(log n):
+     subtreePower(node) - effectivePower() summed over the node's subtree (point values, range sum)
+     pathPower(node)    - summed from the root down to the node (each value is range-added over
+                          its own subtree, so a path sum is a prefix sum at the node)
+   upgrade()/refresh() keep both current after a skill changes in O(log n). Inserting or removing
+   nodes changes the tour, so it needs rebuild() (O(n)).
+*/
+class FenwickTree {
+    vector<long long> t; // 1-based
+public:
+    FenwickTree() = default;
+    // O(n) construction from initial values
+    explicit FenwickTree(const vector<long long>& values) : t(values.size() + 1, 0) {
+        for (size_t i = 1;i < t.size();i++) {
+            t[i] += values[i - 1];
+            size_t j = i + (i & (~i + 1));
+            if (j < t.size()) t[j] += t[i];
+        }
+    }
+    size_t size() const { return t.empty() ? 0 : t.size() - 1; }
+    void add(size_t i, long long delta) {
+        for (i++;i < t.size();i += i & (~i + 1)) t[i] += delta;
+    }
+    // sum of [0, i)
+    long long prefix(size_t i) const {
+        long long s = 0;
+        for (;i > 0;i -= i & (~i + 1)) s += t[i];
+        return s;
+    }
+    long long range(size_t from, size_t to) const { return prefix(to) - prefix(from); }
+};
+
+// iterative preorder tour (deep trees cannot overflow the stack); the subtree of order[i] is [i, subtreeEnd[i])
+void eulerTour(SkillTreeNode* root, vector<SkillTreeNode*>& order, vector<uint32_t>& subtreeEnd) {
+    order.clear();
+    subtreeEnd.clear();
+    vector<pair<SkillTreeNode*, size_t>> stack; // node, next child to visit
+    vector<uint32_t> open;
+    if (root) stack.push_back({ root, 0 });
+    while (!stack.empty()) {
+        auto& [node, next] = stack.back();
+        if (next == 0) {
+            open.push_back(uint32_t(order.size()));
+            order.push_back(node);
+            subtreeEnd.push_back(0);
+        }
+        if (next < node->childCount()) {
+            SkillTreeNode* child = node->child(next++);
+            stack.push_back({ child, 0 });
+            continue;
+        }
+        subtreeEnd[open.back()] = uint32_t(order.size());
+        open.pop_back();
+        stack.pop_back();
+    }
+}
+
+class SkillTreeAggregates {
+    vector<SkillTreeNode*> order;                           // preorder
+    vector<uint32_t> subtreeEnd;                            // subtree of order[i] is [i, subtreeEnd[i])
+    vector<int> value;                                      // effectivePower() as last seen
+    unordered_map<const SkillTreeNode*, uint32_t> position; // node -> preorder index
+    FenwickTree points; // value at its own position
+    FenwickTree paths;  // +value at subtree start, -value at subtree end
+public:
+    template<typename T>
+    explicit SkillTreeAggregates(const SkillTree<T>& tree) { rebuild(tree.getRoot()); }
+
+    void rebuild(SkillTreeNode* root) {
+        eulerTour(root, order, subtreeEnd);
+        value.resize(order.size());
+        position.clear();
+        for (size_t i = 0;i < order.size();i++) {
+            position[order[i]] = uint32_t(i);
+            value[i] = power(order[i]);
+        }
+        vector<long long> pointValues(order.size()), pathDiffs(order.size() + 1, 0);
+        for (size_t i = 0;i < order.size();i++) {
+            pointValues[i] = value[i];
+            pathDiffs[i] += value[i];
+            pathDiffs[subtreeEnd[i]] -= value[i];
+        }
+        pathDiffs.pop_back(); // the slot past the end is never queried
+        points = FenwickTree(pointValues);
+        paths = FenwickTree(pathDiffs);
+    }
+
+    bool contains(const SkillTreeNode* n) const { return position.count(n) != 0; }
+    size_t size() const { return order.size(); }
+
+    long long subtreePower(const SkillTreeNode* n) const {
+        uint32_t i = position.at(n);
+        return points.range(i, subtreeEnd[i]);
+    }
+    long long pathPower(const SkillTreeNode* n) const { return paths.prefix(position.at(n) + 1); }
+    long long totalPower() const { return points.prefix(points.size()); }
+
+    // Skill::upgrade() plus the O(log n) index update
+    void upgrade(SkillTreeNode* n) {
+        if (!n->getSkill()) return;
+        n->getSkill()->upgrade();
+        refresh(n);
+    }
+    // re-reads the node's effectivePower() after its skill changed elsewhere
+    void refresh(const SkillTreeNode* n) {
+        uint32_t i = position.at(n);
+        int now = power(n);
+        long long delta = now - value[i];
+        if (!delta) return;
+        value[i] = now;
+        points.add(i, delta);
+        paths.add(i, delta);
+        if (subtreeEnd[i] < order.size()) paths.add(subtreeEnd[i], -delta);
+    }
+
+private:
+    static int power(const SkillTreeNode* n) { return n->getSkill() ? n->getSkill()->effectivePower() : 0; }
+};
+
+/* --------------------- Character hierarchy --------------------- */
+// cached sum owned by a Party; members mark it stale when their power changes. Const readers may
+// fill a cache concurrently (tournaments, matchmaking); mutations need exclusive access, as for
+// every other non-const member.
+struct PowerCache {
+    static constexpr int64_t stale = INT64_MIN; // outside the int range of any real power
+    atomic<int64_t> value{ stale };
+};
+
+class Character {
+    friend class SnapshotCodec;
+    friend class Party;
+    friend class Skill; // Skill::upgrade calls powerChanged
+    mutable PowerCache power;
+    PowerCache* partyPower = nullptr; // set while the character belongs to a party
+protected:
+    Symbol name;
+    int hp;
+    int mana;
+    int attackPower;
+    int defense;
+    int level;
+    vector<unique_ptr<Skill>> ownedSkills; // owns some skills
+    Inventory<Item> inventory; // composition of template Inventory
+    Logger& logger;
+public:
+    Character(Name n, Logger& log)
+        : name(n), hp(100), mana(50), attackPower(10), defense(5), level(1), inventory(10), logger(log) {
+    }
+protected:
+    Character(const Character& o, Logger& log)
+        : name(o.name), hp(o.hp), mana(o.mana), attackPower(o.attackPower), defense(o.defense), level(o.level),
+        inventory(o.inventory), logger(log) {
+        ownedSkills.reserve(o.ownedSkills.size());
+        for (auto& s : o.ownedSkills) holdSkill(s->clone());
+    }
+public:
+
+    virtual ~Character() = default;
+
+    // deep copy bound to another logger (skills are cloned, inventory copied)
+    virtual unique_ptr<Character> clone(Logger& log) const = 0;
+
+    // non-trivial: attack uses attackPower & level & some randomness
+    virtual int attack(Character& target) {
+        LAB_PROBE(ATTACK);
+        int raw = attackPower + level * 2;
+        int variance = rollRand() % (level + 3);
+        int dmg = max(0, raw + variance - target.getDefense());
+        target.takeDamage(dmg);
+        logger.emit(Logger::INFO, [&] { return LogEvent(LogEvent::ATTACK, Logger::INFO, name.view(), "", target.getName(), dmg); });
+        return dmg;
+    }
+
+    virtual void useSkill(size_t idx, Character& target) {
+        LAB_PROBE(USE_SKILL);
+        if (idx >= ownedSkills.size()) {
+            logger.emit(Logger::WARN, [&] { return LogEvent(LogEvent::INVALID_SKILL, Logger::WARN, name.view()); });
+            return;
+        }
+        Skill* sk = ownedSkills[idx].get();
+        if (!sk) return;
+        logger.emit(Logger::INFO, [&] { return LogEvent(LogEvent::USE_SKILL, Logger::INFO, name.view(), sk->getName(), target.getName()); });
+        sk->apply(target); // dynamic dispatch
+    }
+
+    virtual void equipSkill(unique_ptr<Skill> s) {
+        if (!s) return;
+        logger.emit(Logger::INFO, [&] { return LogEvent(LogEvent::EQUIP_SKILL, Logger::INFO, name.view(), s->getName()); });
+        holdSkill(move(s));
+        powerChanged();
+    }
+
+    void upgradeSkill(size_t idx) {
+        if (idx >= ownedSkills.size() || !ownedSkills[idx]) return;
+        ownedSkills[idx]->upgrade(); // calls powerChanged
+    }
+
+    virtual void levelUp() {
+        level++;
+        hp += 10;
+        mana += 5;
+        attackPower += 2;
+        defense += 1;
+        powerChanged();
+        logger.emit(Logger::INFO, [&] { return LogEvent(LogEvent::LEVEL_UP, Logger::INFO, name.view(), "", "", level); });
+    }
+
+    virtual void takeDamage(int d) {
+        hp -= d;
+        if (hp < 0) hp = 0;
+    }
+
+    virtual int getHP() const { return hp; }
+    virtual int getMana() const { return mana; }
+    virtual int getDefense() const { return defense; }
+    int getAttackPower() const { return attackPower; }
+    int getLevel() const { return level; }
+    string_view getName() const { return name.view(); }
+    Symbol getSymbol() const { return name; }
+    Logger& getLogger() const { return logger; }
+
+    // actions per 1000 timeline ticks
+    virtual int getSpeed() const { return 10 + level; }
+    // mana this character pays to cast `s`
+    virtual int skillCost(const Skill& s) const { return s.getManaCost(); }
+
+    virtual string status() const {
+        return name.str() + " (lvl " + to_string(level) + ") HP:" + to_string(hp) + " MP:" + to_string(mana);
+    }
+
+    // cached; O(1) until the next levelUp / equipSkill / upgradeSkill / class buff
+    virtual int overallPower() const {
+        int64_t v = power.value.load(memory_order_relaxed);
+        if (v == PowerCache::stale) { // racing readers compute and store the same value
+            v = computeOverallPower();
+            power.value.store(v, memory_order_relaxed);
+        }
+        return int(v);
+    }
+    // non-trivial: compute overall power from stats and skills
+    int computeOverallPower() const {
+        int p = statPower(attackPower, level);
+        for (auto& s : ownedSkills) p += s->effectivePower() / 2;
+        return p;
+    }
+    // stat part of overallPower, shared with the devirtualized StaticParty path
+    static int statPower(int attackPower, int level) { return attackPower + level * 3; }
+
+    Inventory<Item>& getInventory() { return inventory; }
+    size_t skillCount() const { return ownedSkills.size(); }
+    const Skill* getSkill(size_t idx) const { return idx < ownedSkills.size() ? ownedSkills[idx].get() : nullptr; }
+
+protected:
+    // takes the skill and registers as its owner, so upgrading it later still reaches powerChanged
+    void holdSkill(unique_ptr<Skill> s) {
+        s->owner.character = this;
+        ownedSkills.push_back(move(s));
+    }
+    // every mutation that can change overallPower must call this
+    void powerChanged() {
+        power.value.store(PowerCache::stale, memory_order_relaxed);
+        if (partyPower) partyPower->value.store(PowerCache::stale, memory_order_relaxed);
+    }
+};
+
+/* Derived classes: Warrior, Mage, Archer */
+class Warrior : public Character {
+    friend class SnapshotCodec;
+    int rage;
+public:
+    Warrior(Name n, Logger& log) : Character(n, log), rage(0) {
+        attackPower += 5;
+        defense += 3;
+    }
+    Warrior(const Warrior& o, Logger& log) : Character(o, log), rage(o.rage) {}
+    unique_ptr<Character> clone(Logger& log) const override { return unique_ptr<Character>(new Warrior(*this, log)); }
+    int attack(Character& target) override {
+        rage = min(100, rage + 10);
+        int base = Character::attack(target);
+        // warrior special: bonus when rage enough
+        if (rage >= 50) {
+            int bonus = 5 + level;
+            target.takeDamage(bonus);
+            logger.emit(Logger::INFO, [&] { return LogEvent(LogEvent::RAGE_BONUS, Logger::INFO, name.view(), "", "", bonus); });
+            rage = 0;
+            return base + bonus;
+        }
+        return base;
+    }
+    int getRage() const { return rage; }
+    void battleShout() {
+        // non-trivial buff to self
+        attackPower += 2;
+        powerChanged();
+        logger.emit(Logger::INFO, [&] { return LogEvent(LogEvent::SHOUT, Logger::INFO, name.view()); });
+    }
+};
+
+class Mage : public Character {
+    friend class SnapshotCodec;
+    int spellPower;
+public:
+    Mage(Name n, Logger& log) : Character(n, log), spellPower(10) {
+        mana += 30;
+    }
+    Mage(const Mage& o, Logger& log) : Character(o, log), spellPower(o.spellPower) {}
+    unique_ptr<Character> clone(Logger& log) const override { return unique_ptr<Character>(new Mage(*this, log)); }
+    void useSkill(size_t idx, Character& target) override {
+        LAB_PROBE(USE_SKILL);
+        // mana check non-trivial
+        if (idx >= skillCount()) { logger.emit(Logger::WARN, [] { return LogEvent::text(Logger::WARN, "Invalid skill idx"); }); return; }
+        Skill* sk = ownedSkills[idx].get();
+        if (!sk) return;
+        int cost = skillCost(*sk);
+        if (mana < cost) {
+            logger.emit(Logger::WARN, [&] { return LogEvent(LogEvent::NO_MANA, Logger::WARN, name.view(), sk->getName(), "", mana); });
+            return;
+        }
+        mana -= cost;
+        logger.emit(Logger::INFO, [&] { return LogEvent(LogEvent::CAST, Logger::INFO, name.view(), sk->getName(), "", cost); });
+        sk->apply(target);
+    }
+    int skillCost(const Skill& s) const override { return max(5, s.effectivePower() / 3); }
+    int getSpellPower() const { return spellPower; }
+};
+
+class Archer : public Character {
+    friend class SnapshotCodec;
+    int agility;
+public:
+    Archer(Name n, Logger& log) : Character(n, log), agility(12) {
+        attackPower += 2;
+    }
+    Archer(const Archer& o, Logger& log) : Character(o, log), agility(o.agility) {}
+    unique_ptr<Character> clone(Logger& log) const override { return unique_ptr<Character>(new Archer(*this, log)); }
+    int getSpeed() const override { return Character::getSpeed() + agility / 3; }
+    int attack(Character& target) override {
+        // chance to critical hit depending on agility
+        int chance = min(50, agility + level);
+        int r = rollRand() % 100;
+        if (r < chance) {
+            int dmg = Character::attack(target) + 7;
+            logger.emit(Logger::INFO, [&] { return LogEvent(LogEvent::CRITICAL, Logger::INFO, name.view()); });
+            return dmg;
+        }
+        else {
+            return Character::attack(target);
+        }
+    }
+    int getAgility() const { return agility; }
+    void dodge() {
+        // non-trivial defensive move
+        defense += 2;
+        powerChanged();
+        logger.emit(Logger::INFO, [&] { return LogEvent(LogEvent::DODGE, Logger::INFO, name.view()); });
+    }
+};
+
+// class-less fighter: plain Character behaviour (BattleRules::BASE, SnapshotMember::BASE)
+class Commoner final : public Character {
+public:
+    Commoner(Name n, Logger& log) : Character(n, log) {}
+    Commoner(const Commoner& o, Logger& log) : Character(o, log) {}
+    unique_ptr<Character> clone(Logger& log) const override { return unique_ptr<Character>(new Commoner(*this, log)); }
+};
+
+/* Implementations of Skill::upgrade / Skill::apply now that Character is declared */
+void Skill::upgrade() {
+    level++;
+    basePower = basePower + 2;
+    if (owner.character) owner.character->powerChanged();
+}
+
+void ActiveSkill::apply(Character& target) {
+    LAB_PROBE(SKILL_APPLY);
+    // Deal damage to target based on effectivePower
+    int p = effectivePower();
+    int variance = rollRand() % 5;
+    int dmg = max(1, p + variance - target.getDefense());
+    target.takeDamage(dmg);
+    target.getLogger().emit(Logger::INFO, [&] { return LogEvent(LogEvent::SKILL_HIT, Logger::INFO, "", name.view(), target.getName(), dmg); });
+}
+
+void PassiveSkill::apply(Character& target) {
+    LAB_PROBE(SKILL_APPLY);
+    // Passive skill modifies target's stats slightly (non-trivial)
+    // We'll attempt to dynamic_cast to specific types for different effects (example)
+    // Since Character's fields are protected, we cannot change them directly; instead we log the conceptual effect.
+    target.getLogger().emit(Logger::INFO, [&] { return LogEvent(LogEvent::PASSIVE_BUFF, Logger::INFO, "", name.view(), target.getName()); });
+}
+
+void UltimateSkill::apply(Character& target) {
+    LAB_PROBE(SKILL_APPLY);
+    int p = effectivePower();
+    int dmg = max(5, p - target.getDefense());
+    target.takeDamage(dmg);
+    target.getLogger().emit(Logger::INFO, [&] { return LogEvent(LogEvent::ULTIMATE_HIT, Logger::INFO, "", name.view(), target.getName(), dmg); });
+}
+
+/* --------------------- Party (collection of characters demonstrating polymorphism use) --------------------- */
+class Party {
+    friend class SnapshotCodec;
+    vector<unique_ptr<Character>> members;
+    Logger& logger;
+    unique_ptr<PowerCache> power; // heap-held so members' back pointers survive moving the party (null once moved from)
+public:
+    Party(Logger& log) : logger(log), power(make_unique<PowerCache>()) {}
+    void addMember(unique_ptr<Character> c) {
+        logger.emit(Logger::INFO, [&] { return LogEvent(LogEvent::ADD_MEMBER, Logger::INFO, c->getName()); });
+        adopt(move(c));
+    }
+    Character* getMember(size_t idx) {
+        if (idx >= members.size()) return nullptr;
+        return members[idx].get();
+    }
+    const Character* getMember(size_t idx) const {
+        if (idx >= members.size()) return nullptr;
+        return members[idx].get();
+    }
+    size_t size() const { return members.size(); }
+
+    // deep copy of every member, bound to another logger (no "Adding member" log spam)
+    Party clone(Logger& log) const {
+        Party p(log);
+        p.members.reserve(members.size());
+        for (auto& m : members) p.adopt(m->clone(log));
+        return p;
+    }
+
+    // cached; recomputed (from the members' cached values) only after a member changed
+    int combinedPower() const {
+        if (!power) return 0; // moved from: no members
+        int64_t v = power->value.load(memory_order_relaxed);
+        if (v == PowerCache::stale) {
+            int sum = 0;
+            for (auto& m : members) sum += m->overallPower();
+            power->value.store(v = sum, memory_order_relaxed);
+        }
+        return int(v);
+    }
+
+    void showStatus() const {
+        logger.emit(Logger::INFO, [] { return LogEvent::text(Logger::INFO, "Party status:"); });
+        for (auto& m : members) cout << "  " << m->status() << "\n";
+    }
+
+private:
+    void adopt(unique_ptr<Character> c) {
+        if (!power) power = make_unique<PowerCache>();
+        c->partyPower = power.get();
+        power->value.store(PowerCache::stale, memory_order_relaxed);
+        members.push_back(move(c));
+    }
+};
+
+/* --------------------- StaticSkill (closed-set, compile-time dispatch) ---------------------
+   The skill kinds are a closed set, so hot paths can hold them by value in a variant and
+   dispatch with std::visit. Each call is made qualified (s.T::f()), which binds it at compile
+   time to the same member function the virtual call would reach, so results are identical
+   and the bodies can be inlined.
+*/
+class StaticSkill {
+    variant<ActiveSkill, PassiveSkill, UltimateSkill> v;
+public:
+    template<typename T>
+    StaticSkill(T s) : v(move(s)) {}
+
+    // copy of a polymorphic skill (UltimateSkill tested before its base ActiveSkill)
+    static optional<StaticSkill> from(const Skill& s) {
+        if (auto u = dynamic_cast<const UltimateSkill*>(&s)) return StaticSkill(*u);
+        if (auto a = dynamic_cast<const ActiveSkill*>(&s)) return StaticSkill(*a);
+        if (auto p = dynamic_cast<const PassiveSkill*>(&s)) return StaticSkill(*p);
+        return nullopt;
+    }
+
+    int effectivePower() const {
+        return visit([](const auto& s) { using T = decay_t<decltype(s)>; return s.T::effectivePower(); }, v);
+    }
+    int describe(char* out, size_t cap) const {
+        return visit([&](const auto& s) { using T = decay_t<decltype(s)>; return s.T::describeWith(out, cap, s.T::effectivePower()); }, v);
+    }
+    string description() const {
+        string out;
+        Skill::appendFormatted(out, [&](char* p, size_t cap) { return describe(p, cap); });
+        return out;
+    }
+    void apply(Character& target) {
+        visit([&](auto& s) { using T = decay_t<decltype(s)>; s.T::apply(target); }, v);
+    }
+    void upgrade() {
+        visit([](auto& s) { using T = decay_t<decltype(s)>; s.T::upgrade(); }, v);
+    }
+    string_view getName() const {
+        return visit([](const auto& s) { return s.getName(); }, v);
+    }
+};
+
+// devirtualized snapshot of a party for power queries (matchmaking); rebuild after stat changes
+class StaticParty {
+    struct Member { int attackPower, level; uint32_t firstSkill, skillCount; };
+    vector<Member> members;
+    vector<StaticSkill> skills; // all members' skills back to back
+public:
+    static StaticParty fromParty(const Party& p) {
+        StaticParty sp;
+        for (size_t i = 0;i < p.size();i++) {
+            const Character* c = p.getMember(i);
+            Member m{ c->getAttackPower(), c->getLevel(), static_cast<uint32_t>(sp.skills.size()), 0 };
+            for (size_t k = 0;k < c->skillCount();k++)
+                if (auto s = StaticSkill::from(*c->getSkill(k))) { sp.skills.push_back(move(*s)); m.skillCount++; }
+            sp.members.push_back(m);
+        }
+        return sp;
+    }
+
+    // same formula as Character::overallPower
+    int overallPower(size_t idx) const {
+        const Member& m = members[idx];
+        int p = Character::statPower(m.attackPower, m.level);
+        for (uint32_t k = m.firstSkill;k < m.firstSkill + m.skillCount;k++) p += skills[k].effectivePower() / 2;
+        return p;
+    }
+    int combinedPower() const {
+        int sum = 0;
+        for (size_t i = 0;i < members.size();i++) sum += overallPower(i);
+        return sum;
+    }
+    size_t size() const { return members.size(); }
+};
+
+/* --------------------- Snapshot (versioned binary content format, mmap-friendly) ---------------------
+   Layout (little-endian, every section 8-byte aligned, all records fixed size):
+       SnapshotHeader | SnapshotSkill[] | SnapshotNode[] (tree, preorder) | SnapshotMember[] | SnapshotItem[] | chars
+   Names are (offset, length) pairs into the trailing string table, so a mapped file is usable
+   as-is through SnapshotView; loading into objects is a single linear pass with exact sizes.
+*/
+struct SnapshotHeader {
+    char magic[4];          // "LBSN"
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t skillCount, nodeCount, memberCount, itemCount;
+    uint64_t skillsOffset, nodesOffset, membersOffset, itemsOffset, stringsOffset, stringBytes;
+    static constexpr uint16_t currentVersion = 2; // bump on any record layout change
+};
+
+struct SnapshotSkill {
+    enum Kind : uint8_t { ACTIVE, PASSIVE, ULTIMATE };
+    uint32_t nameOffset, nameLength;
+    uint8_t kind;
+    uint8_t pad[3];
+    int32_t level, basePower, manaCost, cooldown;
+    double modifier;
+};
+
+struct SnapshotNode {
+    uint32_t skill;  // index into skills, UINT32_MAX for an empty node
+    uint32_t parent; // preorder index of the parent, UINT32_MAX for the root
+};
+
+struct SnapshotMember {
+    enum Kind : uint8_t { WARRIOR, MAGE, ARCHER, BASE }; // BASE: Commoner
+    uint32_t nameOffset, nameLength;
+    uint8_t kind;
+    uint8_t pad[3];
+    int32_t hp, mana, attackPower, defense, level, special; // special: rage / spellPower / agility
+    uint32_t firstSkill, skillCount, firstItem, itemCount, inventoryCapacity, pad2;
+};
+
+struct SnapshotItem {
+    uint32_t nameOffset, nameLength;
+    int32_t value;
+    uint32_t pad;
+};
+
+// zero-copy access to a mapped snapshot; records are used in place. open() checks every record
+// (indices, ranges, kinds, parent order), so a view that opened is safe to load from.
+class SnapshotView {
+    MappedFile file;
+    const SnapshotHeader* h = nullptr;
+public:
+    bool open(const string& path) {
+        h = nullptr;
+        if (!file.open(path) || file.size() < sizeof(SnapshotHeader)) return false;
+        const SnapshotHeader* hdr = reinterpret_cast<const SnapshotHeader*>(file.data());
+        if (memcmp(hdr->magic, "LBSN", 4) != 0 || hdr->version != SnapshotHeader::currentVersion || hdr->headerSize != sizeof(SnapshotHeader)) return false;
+        auto fits = [&](uint64_t off, uint64_t bytes) { return off % 8 == 0 && off <= file.size() && bytes <= file.size() - off; };
+        if (!fits(hdr->skillsOffset, uint64_t(hdr->skillCount) * sizeof(SnapshotSkill))
+            || !fits(hdr->nodesOffset, uint64_t(hdr->nodeCount) * sizeof(SnapshotNode))
+            || !fits(hdr->membersOffset, uint64_t(hdr->memberCount) * sizeof(SnapshotMember))
+            || !fits(hdr->itemsOffset, uint64_t(hdr->itemCount) * sizeof(SnapshotItem))
+            || !fits(hdr->stringsOffset, hdr->stringBytes)) return false;
+        h = hdr;
+        if (!recordsValid()) h = nullptr;
+        return h != nullptr;
+    }
+    bool isOpen() const { return h != nullptr; }
+
+    const SnapshotHeader& header() const { return *h; }
+    const SnapshotSkill* skills() const { return at<SnapshotSkill>(h->skillsOffset); }
+    const SnapshotNode* nodes() const { return at<SnapshotNode>(h->nodesOffset); }
+    const SnapshotMember* members() const { return at<SnapshotMember>(h->membersOffset); }
+    const SnapshotItem* items() const { return at<SnapshotItem>(h->itemsOffset); }
+    string_view str(uint32_t offset, uint32_t length) const {
+        if (uint64_t(offset) + length > h->stringBytes) return string_view();
+        return string_view(reinterpret_cast<const char*>(file.data() + h->stringsOffset + offset), length);
+    }
+
+private:
+    template<typename T>
+    const T* at(uint64_t offset) const { return reinterpret_cast<const T*>(file.data() + offset); }
+
+    bool recordsValid() const {
+        auto range = [](uint64_t first, uint64_t count, uint64_t size) { return first + count <= size; };
+        auto name = [&](uint32_t off, uint32_t len) { return range(off, len, h->stringBytes); };
+        for (uint32_t i = 0;i < h->skillCount;i++) {
+            const SnapshotSkill& s = skills()[i];
+            if (s.kind > SnapshotSkill::ULTIMATE || !name(s.nameOffset, s.nameLength)) return false;
+        }
+        for (uint32_t i = 0;i < h->nodeCount;i++) { // preorder: the root first, every parent before its children
+            const SnapshotNode& n = nodes()[i];
+            if (i == 0 ? n.parent != UINT32_MAX : n.parent >= i) return false;
+            if (n.skill != UINT32_MAX && n.skill >= h->skillCount) return false;
+        }
+        for (uint32_t i = 0;i < h->memberCount;i++) {
+            const SnapshotMember& m = members()[i];
+            if (m.kind > SnapshotMember::BASE || !name(m.nameOffset, m.nameLength)
+                || !range(m.firstSkill, m.skillCount, h->skillCount) || !range(m.firstItem, m.itemCount, h->itemCount)
+                || m.itemCount > m.inventoryCapacity) return false;
+        }
+        for (uint32_t i = 0;i < h->itemCount;i++)
+            if (!name(items()[i].nameOffset, items()[i].nameLength)) return false;
+        return true;
+    }
+};
+
+class SnapshotCodec {
+public:
+    // writes tree (may be null) and party (may be null) as one snapshot
+    static void save(ostream& out, const SkillTree<Skill*>* tree, const Party* party) {
+        Builder b;
+        if (tree && tree->getRoot()) {
+            unordered_map<const SkillTreeNode*, uint32_t> order;
+            tree->getRoot()->dfs([&](SkillTreeNode* node) {
+                uint32_t parent = node->getParent() ? order.at(node->getParent()) : UINT32_MAX;
+                order.emplace(node, uint32_t(b.nodes.size()));
+                b.nodes.push_back({ node->getSkill() ? b.addSkill(*node->getSkill()) : UINT32_MAX, parent });
+                });
+        }
+        if (party) b.addParty(*party);
+        b.write(out);
+    }
+
+    // arena-backed tree: skills are constructed inside the tree, children ranges sized exactly.
+    // Loaders need a view that opened: its records have been validated.
+    static void loadTree(const SnapshotView& v, FlatSkillTree& tree) {
+        if (!v.isOpen()) throw invalid_argument("SnapshotCodec: view is not open");
+        const SnapshotNode* nodes = v.nodes();
+        tree.assignPreorder(v.header().nodeCount,
+            [&](size_t i) { return nodes[i].skill == UINT32_MAX ? nullptr : makeSkill(v, v.skills()[nodes[i].skill], &tree.arena); },
+            [&](size_t i) { return nodes[i].parent; });
+    }
+
+    // linked tree: the skills go in an arena the tree keeps, so nothing is left for the caller to free
+    static void loadTree(const SnapshotView& v, SkillTree<Skill*>& tree) {
+        if (!v.isOpen()) throw invalid_argument("SnapshotCodec: view is not open");
+        const SnapshotNode* nodes = v.nodes();
+        tree.assignPreorder(v.header().nodeCount,
+            [&](Arena& arena, size_t i) { return nodes[i].skill == UINT32_MAX ? nullptr : makeSkill(v, v.skills()[nodes[i].skill], &arena); },
+            [&](size_t i) { return nodes[i].parent; });
+    }
+
+    static Party loadParty(const SnapshotView& v, Logger& log) {
+        if (!v.isOpen()) throw invalid_argument("SnapshotCodec: view is not open");
+        Party p(log);
+        p.members.reserve(v.header().memberCount);
+        for (uint32_t i = 0;i < v.header().memberCount;i++) {
+            const SnapshotMember& r = v.members()[i];
+            Symbol name(v.str(r.nameOffset, r.nameLength));
+            unique_ptr<Character> c;
+            if (r.kind == SnapshotMember::WARRIOR) { auto w = make_unique<Warrior>(name, log); w->rage = r.special; c = move(w); }
+            else if (r.kind == SnapshotMember::MAGE) { auto m = make_unique<Mage>(name, log); m->spellPower = r.special; c = move(m); }
+            else if (r.kind == SnapshotMember::ARCHER) { auto a = make_unique<Archer>(name, log); a->agility = r.special; c = move(a); }
+            else c = make_unique<Commoner>(name, log);
+            c->hp = r.hp; c->mana = r.mana; c->attackPower = r.attackPower; c->defense = r.defense; c->level = r.level;
+            c->ownedSkills.reserve(r.skillCount);
+            for (uint32_t k = 0;k < r.skillCount;k++)
+                c->holdSkill(unique_ptr<Skill>(makeSkill(v, v.skills()[r.firstSkill + k], nullptr)));
+            c->inventory = Inventory<Item>(r.inventoryCapacity);
+            for (uint32_t k = 0;k < r.itemCount;k++) {
+                const SnapshotItem& it = v.items()[r.firstItem + k];
+                c->inventory.add(Item(v.str(it.nameOffset, it.nameLength), it.value));
+            }
+            p.adopt(move(c));
+        }
+        return p;
+    }
+
+private:
+    // arena != null: skill lives in a tree's arena; otherwise on the heap (owned by a Character)
+    static Skill* makeSkill(const SnapshotView& v, const SnapshotSkill& r, Arena* arena) {
+        Symbol name(v.str(r.nameOffset, r.nameLength));
+        Skill* s;
+        if (r.kind == SnapshotSkill::PASSIVE) {
+            s = arena ? arena->make<PassiveSkill>(name, r.basePower, r.modifier) : new PassiveSkill(name, r.basePower, r.modifier);
+        }
+        else if (r.kind == SnapshotSkill::ULTIMATE) {
+            s = arena ? arena->make<UltimateSkill>(name, r.basePower, r.manaCost, r.cooldown)
+                : new UltimateSkill(name, r.basePower, r.manaCost, r.cooldown);
+        }
+        else {
+            s = arena ? arena->make<ActiveSkill>(name, r.basePower, r.manaCost) : new ActiveSkill(name, r.basePower, r.manaCost);
+        }
+        s->level = r.level;
+        return s;
+    }
+
+    struct Builder {
+        vector<SnapshotSkill> skills;
+        vector<SnapshotNode> nodes;
+        vector<SnapshotMember> members;
+        vector<SnapshotItem> items;
+        string strings;
+
+        pair<uint32_t, uint32_t> addString(string_view s) {
+            if (strings.size() + s.size() > UINT32_MAX) throw length_error("SnapshotCodec: string table exceeds 4 GiB");
+            pair<uint32_t, uint32_t> r{ uint32_t(strings.size()), uint32_t(s.size()) };
+            strings += s;
+            return r;
+        }
+        uint32_t addSkill(const Skill& s) {
+            SnapshotSkill r{};
+            auto [off, len] = addString(s.name.view());
+            r.nameOffset = off;
+            r.nameLength = len;
+            r.level = s.level;
+            r.basePower = s.basePower;
+            // exact types only: a subclass would load back as its base and lose its behaviour
+            const type_info& type = typeid(s);
+            if (type == typeid(UltimateSkill)) {
+                auto& u = static_cast<const UltimateSkill&>(s);
+                r.kind = SnapshotSkill::ULTIMATE; r.manaCost = u.manaCost; r.cooldown = u.cooldown;
+            }
+            else if (type == typeid(ActiveSkill)) { r.kind = SnapshotSkill::ACTIVE; r.manaCost = static_cast<const ActiveSkill&>(s).manaCost; }
+            else if (type == typeid(PassiveSkill)) { r.kind = SnapshotSkill::PASSIVE; r.modifier = static_cast<const PassiveSkill&>(s).modifier; }
+            else throw invalid_argument("SnapshotCodec: cannot encode skill type " + string(type.name()));
+            skills.push_back(r);
+            return uint32_t(skills.size() - 1);
+        }
+        void addParty(const Party& p) {
+            for (auto& c : p.members) {
+                SnapshotMember r{};
+                auto [off, len] = addString(c->name.view());
+                r.nameOffset = off;
+                r.nameLength = len;
+                const type_info& type = typeid(*c);
+                if (type == typeid(Warrior)) { r.kind = SnapshotMember::WARRIOR; r.special = static_cast<const Warrior&>(*c).rage; }
+                else if (type == typeid(Mage)) { r.kind = SnapshotMember::MAGE; r.special = static_cast<const Mage&>(*c).spellPower; }
+                else if (type == typeid(Archer)) { r.kind = SnapshotMember::ARCHER; r.special = static_cast<const Archer&>(*c).agility; }
+                else if (type == typeid(Commoner)) r.kind = SnapshotMember::BASE;
+                else throw invalid_argument("SnapshotCodec: cannot encode character type " + string(type.name()));
+                r.hp = c->hp; r.mana = c->mana; r.attackPower = c->attackPower; r.defense = c->defense; r.level = c->level;
+                r.firstSkill = uint32_t(skills.size());
+                for (auto& s : c->ownedSkills) addSkill(*s);
+                r.skillCount = uint32_t(skills.size()) - r.firstSkill;
+                r.firstItem = uint32_t(items.size());
+                for (auto& it : c->inventory.view()) {
+                    auto [ioff, ilen] = addString(it.getName());
+                    items.push_back({ ioff, ilen, it.getValue(), 0 });
+                }
+                r.itemCount = uint32_t(items.size()) - r.firstItem;
+                r.inventoryCapacity = uint32_t(c->inventory.getCapacity());
+                members.push_back(r);
+            }
+        }
+        void write(ostream& out) const {
+            SnapshotHeader h{};
+            memcpy(h.magic, "LBSN", 4);
+            h.version = SnapshotHeader::currentVersion;
+            h.headerSize = sizeof(SnapshotHeader);
+            h.skillCount = uint32_t(skills.size());
+            h.nodeCount = uint32_t(nodes.size());
+            h.memberCount = uint32_t(members.size());
+            h.itemCount = uint32_t(items.size());
+            uint64_t pos = align8(sizeof(SnapshotHeader));
+            auto place = [&](uint64_t& off, uint64_t bytes) { off = pos; pos = align8(pos + bytes); };
+            place(h.skillsOffset, skills.size() * sizeof(SnapshotSkill));
+            place(h.nodesOffset, nodes.size() * sizeof(SnapshotNode));
+            place(h.membersOffset, members.size() * sizeof(SnapshotMember));
+            place(h.itemsOffset, items.size() * sizeof(SnapshotItem));
+            place(h.stringsOffset, strings.size());
+            h.stringBytes = strings.size();
+
+            uint64_t written = 0;
+            auto put = [&](uint64_t off, const void* data, size_t bytes) {
+                static const char zeros[8] = {};
+                out.write(zeros, streamsize(off - written)); // alignment padding
+                out.write(static_cast<const char*>(data), streamsize(bytes));
+                written = off + bytes;
+            };
+            put(0, &h, sizeof(h));
+            put(h.skillsOffset, skills.data(), skills.size() * sizeof(SnapshotSkill));
+            put(h.nodesOffset, nodes.data(), nodes.size() * sizeof(SnapshotNode));
+            put(h.membersOffset, members.data(), members.size() * sizeof(SnapshotMember));
+            put(h.itemsOffset, items.data(), items.size() * sizeof(SnapshotItem));
+            put(h.stringsOffset, strings.data(), strings.size());
+        }
+        static uint64_t align8(uint64_t v) { return (v + 7) & ~uint64_t(7); }
+    };
+};
+
+/* --------------------- BattleSimulator --------------------- */
+struct BattleResult {
+    enum Outcome { A_WINS, B_WINS, DRAW };
+    Outcome outcome = DRAW;
+    size_t turns = 0;
+    int damageByA = 0; // total damage dealt by party A
+    int damageByB = 0;
+};
+
+/* --------------------- Replay log (compact binary battle events) ---------------------
+   Append-only stream: a file header, then one self-delimiting block per battle
+       ReplayBattleHeader | uint16 initial HP per member (A then B, padded to 4 bytes) | uint32 events
+   Each event packs into 32 bits (little-endian host assumed); damage is the HP actually removed:
+       bits 0-1 kind | 2-7 actor slot | 8-13 target slot | 14-17 skill index | 18-31 damage
+   A slot is side * 32 + member index. The writer rejects a battle the format cannot hold (more
+   than 32 members a side, more than 16 skills on a member, or more than 16383 HP on a member,
+   which bounds the damage of every hit) before it starts, so no field is ever truncated.
+*/
+struct ReplayFileHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+};
+
+struct ReplayBattleHeader {
+    uint64_t seed;
+    uint64_t battleId;
+    uint32_t eventCount;
+    uint16_t turns;
+    uint8_t sizeA, sizeB;
+    uint8_t outcome;   // BattleResult::Outcome
+    uint8_t flags;     // SEEDED when the battle ran from an explicit seed
+    uint8_t pad[6];
+    enum : uint8_t { SEEDED = 1 };
+};
+
+struct ReplayEvent {
+    enum Kind : uint32_t { ATTACK = 0, SKILL = 1, DEATH = 2 };
+    static constexpr uint32_t maxDamage = (1u << 14) - 1;
+    static constexpr size_t maxPartySize = 32, maxSkills = 16;
+
+    static uint32_t pack(Kind k, uint32_t actor, uint32_t target, uint32_t skill, int damage) {
+        if (actor >= 64 || target >= 64 || skill >= maxSkills || damage < 0 || uint32_t(damage) > maxDamage)
+            throw out_of_range("ReplayEvent: field does not fit the event encoding");
+        return k | actor << 2 | target << 8 | skill << 14 | uint32_t(damage) << 18;
+    }
+    static Kind kind(uint32_t e) { return Kind(e & 3u); }
+    static uint32_t actor(uint32_t e) { return (e >> 2) & 63u; }
+    static uint32_t target(uint32_t e) { return (e >> 8) & 63u; }
+    static uint32_t skill(uint32_t e) { return (e >> 14) & 15u; }
+    static int damage(uint32_t e) { return int(e >> 18); }
+    static uint32_t slot(int side, size_t idx) { return uint32_t(side * 32 + idx); }
+};
+
+class ReplayWriter {
+    ostream& out;
+    ReplayBattleHeader header{};
+    vector<uint16_t> hp;
+    vector<uint32_t> events;
+    uint64_t written = 0;
+    bool open = false;
+public:
+    static constexpr uint16_t version = 1;
+
+    explicit ReplayWriter(ostream& os) : out(os) {
+        ReplayFileHeader fh{ { 'L', 'B', 'R', 'P' }, version, 0 };
+        out.write(reinterpret_cast<const char*>(&fh), sizeof(fh));
+    }
+
+    // whether a battle between these parties can be logged (see ReplayEvent for the limits)
+    static bool fits(const Party& p) {
+        if (p.size() > ReplayEvent::maxPartySize) return false;
+        for (size_t i = 0;i < p.size();i++) {
+            const Character* c = p.getMember(i);
+            if (c->getHP() < 0 || uint32_t(c->getHP()) > ReplayEvent::maxDamage || c->skillCount() > ReplayEvent::maxSkills) return false;
+        }
+        return true;
+    }
+
+    // throws length_error (nothing written, parties untouched) when the battle does not fit
+    void beginBattle(uint64_t battleId, optional<uint64_t> seed, const Party& a, const Party& b) {
+        if (!fits(a) || !fits(b)) throw length_error("ReplayWriter: battle exceeds the replay format limits");
+        header = ReplayBattleHeader{};
+        header.battleId = battleId;
+        header.seed = seed.value_or(0);
+        header.flags = seed ? ReplayBattleHeader::SEEDED : 0;
+        header.sizeA = uint8_t(a.size());
+        header.sizeB = uint8_t(b.size());
+        hp.clear();
+        for (size_t i = 0;i < header.sizeA;i++) hp.push_back(uint16_t(a.getMember(i)->getHP()));
+        for (size_t i = 0;i < header.sizeB;i++) hp.push_back(uint16_t(b.getMember(i)->getHP()));
+        if (hp.size() % 2) hp.push_back(0);
+        events.clear();
+        open = true;
+    }
+    void record(uint32_t packedEvent) { if (open) events.push_back(packedEvent); }
+    void endBattle(const BattleResult& r) {
+        if (!open) return;
+        header.eventCount = uint32_t(events.size());
+        header.turns = uint16_t(r.turns);
+        header.outcome = uint8_t(r.outcome);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(hp.data()), streamsize(hp.size() * sizeof(uint16_t)));
+        out.write(reinterpret_cast<const char*>(events.data()), streamsize(events.size() * sizeof(uint32_t)));
+        written++;
+        open = false;
+    }
+    uint64_t battlesWritten() const { return written; }
+};
+
+class BattleSimulator {
+    Logger& logger;
+    ReplayWriter* replay = nullptr;
+    uint64_t nextBattleId = 0;
+public:
+    BattleSimulator(Logger& log) : logger(log) {}
+
+    // every following battle is appended to the replay stream (nullptr stops recording)
+    void setReplay(ReplayWriter* w) { replay = w; }
+
+    // Simulate a simple skirmish between two parties (non-trivial orchestration)
+    BattleResult simulate(Party& a, Party& b) { return run(a, b, nullopt); }
+
+    // reproducible battle: all randomness comes from an engine seeded with `seed`
+    BattleResult simulate(Party& a, Party& b, uint64_t seed) {
+        SeededRngScope rng(seed);
+        return run(a, b, seed);
+    }
+
+private:
+    BattleResult run(Party& a, Party& b, optional<uint64_t> seed) {
+        if (replay) replay->beginBattle(nextBattleId++, seed, a, b);
+        BattleResult res = fight(a, b);
+        if (replay) replay->endBattle(res);
+        return res;
+    }
+
+    BattleResult fight(Party& a, Party& b) {
+        BattleResult res;
+        logger.emit(Logger::INFO, [] { return LogEvent::text(Logger::INFO, "Battle starts between two parties!"); });
+        size_t turn = 0;
+        while (turn < 50) {
+            LAB_PROBE(SIM_TURN);
+            res.turns = turn;
+            if (allDead(a)) { logger.emit(Logger::INFO, [] { return LogEvent::text(Logger::INFO, "Party A defeated!"); }); res.outcome = BattleResult::B_WINS; return res; }
+            if (allDead(b)) { logger.emit(Logger::INFO, [] { return LogEvent::text(Logger::INFO, "Party B defeated!"); }); res.outcome = BattleResult::A_WINS; return res; }
+
+            // choose random alive from A and B
+            size_t ia = randomAlive(a);
+            size_t ib = randomAlive(b);
+            if (ia == npos || ib == npos) break;
+            Character* ca = a.getMember(ia);
+            Character* cb = b.getMember(ib);
+
+            // alternate: even turns A attacks, odd B attacks
+            if (turn % 2 == 0) {
+                res.damageByA += recordAttack(*ca, ReplayEvent::slot(0, ia), *cb, ReplayEvent::slot(1, ib));
+            }
+            else {
+                res.damageByB += recordAttack(*cb, ReplayEvent::slot(1, ib), *ca, ReplayEvent::slot(0, ia));
+            }
+            turn++;
+        }
+        res.turns = turn;
+        logger.emit(Logger::INFO, [] { return LogEvent::text(Logger::INFO, "Battle ended after max turns."); });
+        if (allDead(a) != allDead(b)) res.outcome = allDead(a) ? BattleResult::B_WINS : BattleResult::A_WINS;
+        return res;
+    }
+
+    int recordAttack(Character& attacker, uint32_t from, Character& target, uint32_t to) {
+        int before = target.getHP();
+        int dmg = attacker.attack(target);
+        if (replay) {
+            // the log stores HP actually removed (reported damage can include overkill or bonus text)
+            replay->record(ReplayEvent::pack(ReplayEvent::ATTACK, from, to, 0, before - target.getHP()));
+            if (target.getHP() == 0) replay->record(ReplayEvent::pack(ReplayEvent::DEATH, to, to, 0, 0));
+        }
+        return dmg;
+    }
+
+public:
+    static constexpr size_t npos = SIZE_MAX;
+
+    // turn-loop helpers, shared with BattleTask
+    static bool allDead(Party& p) {
+        for (size_t i = 0;i < p.size();++i) {
+            Character* c = p.getMember(i);
+            if (c && c->getHP() > 0) return false;
+        }
+        return true;
+    }
+    // one roll picks the k-th alive member (the same pick as indexing a list of them, without building it)
+    static size_t randomAlive(Party& p) {
+        size_t alive = 0;
+        for (size_t i = 0;i < p.size();++i) {
+            Character* c = p.getMember(i);
+            alive += c && c->getHP() > 0;
+        }
+        if (!alive) return npos;
+        size_t k = size_t(rollRand()) % alive;
+        for (size_t i = 0;;++i) {
+            Character* c = p.getMember(i);
+            if (c && c->getHP() > 0 && k-- == 0) return i;
+        }
+    }
+};
+
+/* --------------------- BattleRunner (many resumable battles on one thread) ---------------------
+   C++17 has no coroutines, so a live battle is a hand-written resumable state machine: a
+   BattleTask keeps the state of BattleSimulator's turn loop (turn, result, its own CounterRng),
+   and resume() runs it until the battle ends, the turn budget of the slice is spent, or a
+   player-controlled side has to act. BattleRunner multiplexes any number of tasks on the calling
+   thread: ready tasks take turns from a FIFO, tasks waiting for input stay parked until submit()
+   hands them a move. Each slice installs the task's RNG, so interleaving does not change any
+   battle, and a task without player sides ends exactly like BattleSimulator::simulate(a, b, seed).
+   Parties are borrowed; a task itself is a few dozen bytes.
+*/
+struct BattleInput {
+    uint8_t attacker = 0; // slot in the acting party
+    uint8_t target = 0;   // slot in the opposing party
+};
+
+class BattleTask {
+public:
+    enum State : uint8_t { READY, AWAITING_INPUT, FINISHED };
+    enum : uint8_t { PLAYER_A = 1, PLAYER_B = 2 };
+    static constexpr uint16_t maxTurns = 50;
+
+    BattleTask(Party& a, Party& b, uint64_t seed, uint8_t playerSides = 0)
+        : sides{ &a, &b }, rng(seed), players(playerSides) {}
+
+    State resume(Logger& logger, uint32_t turnBudget = maxTurns) {
+        if (st != READY) return st;
+        RandomScope scope(rng);
+        if (!started) {
+            started = true;
+            logger.emit(Logger::INFO, [] { return LogEvent::text(Logger::INFO, "Battle starts between two parties!"); });
+        }
+        for (;turnBudget > 0;turnBudget--) {
+            LAB_PROBE(SIM_TURN);
+            if (turn >= maxTurns) {
+                res.turns = turn;
+                logger.emit(Logger::INFO, [] { return LogEvent::text(Logger::INFO, "Battle ended after max turns."); });
+                if (BattleSimulator::allDead(*sides[0]) != BattleSimulator::allDead(*sides[1]))
+                    res.outcome = BattleSimulator::allDead(*sides[0]) ? BattleResult::B_WINS : BattleResult::A_WINS;
+                return st = FINISHED;
+            }
+            res.turns = turn;
+            if (BattleSimulator::allDead(*sides[0])) { logger.emit(Logger::INFO, [] { return LogEvent::text(Logger::INFO, "Party A defeated!"); }); res.outcome = BattleResult::B_WINS; return st = FINISHED; }
+            if (BattleSimulator::allDead(*sides[1])) { logger.emit(Logger::INFO, [] { return LogEvent::text(Logger::INFO, "Party B defeated!"); }); res.outcome = BattleResult::A_WINS; return st = FINISHED; }
+            int side = turn % 2;
+            size_t actor, target;
+            if (players & (1 << side)) {
+                if (!hasInput) return st = AWAITING_INPUT;
+                hasInput = false;
+                actor = input.attacker;
+                target = input.target;
+            }
+            else {
+                // same draw order as BattleSimulator: a member of A, then one of B
+                size_t ia = BattleSimulator::randomAlive(*sides[0]);
+                size_t ib = BattleSimulator::randomAlive(*sides[1]);
+                actor = side ? ib : ia;
+                target = side ? ia : ib;
+            }
+            int dmg = sides[side]->getMember(actor)->attack(*sides[1 - side]->getMember(target));
+            (side ? res.damageByB : res.damageByA) += dmg;
+            turn++;
+        }
+        return st;
+    }
+
+    // a move for the side that is waiting; both members must be alive
+    bool provide(BattleInput in) {
+        if (st != AWAITING_INPUT) return false;
+        const Character* actor = sides[sideToAct()]->getMember(in.attacker);
+        const Character* target = sides[1 - sideToAct()]->getMember(in.target);
+        if (!actor || !target || actor->getHP() <= 0 || target->getHP() <= 0) return false;
+        input = in;
+        hasInput = true;
+        st = READY;
+        return true;
+    }
+
+    State state() const { return st; }
+    int sideToAct() const { return turn % 2; }
+    uint16_t turnNumber() const { return turn; }
+    const BattleResult& result() const { return res; }
+    Party& party(int side) const { return *sides[side]; }
+
+private:
+    Party* sides[2];
+    CounterRng rng;
+    BattleResult res;
+    uint16_t turn = 0;
+    State st = READY;
+    uint8_t players;
+    bool started = false;
+    bool hasInput = false;
+    BattleInput input;
+};
+
+class BattleRunner {
+    Logger& logger;
+    vector<BattleTask> tasks;
+    // FIFO ring of ready ids; a task is queued at most once, so tasks.size() slots always suffice
+    vector<uint32_t> ready;
+    size_t readyHead = 0, readyLen = 0;
+    size_t unfinished = 0;
+public:
+    // called when a task parks for input or finishes
+    function<void(uint32_t, const BattleTask&)> onSuspend;
+    uint32_t turnsPerSlice = 1; // turns a task may run before the next ready task gets the thread
+
+    BattleRunner(Logger& log) : logger(log) {}
+
+    uint32_t add(Party& a, Party& b, uint64_t seed, uint8_t playerSides = 0) {
+        tasks.emplace_back(a, b, seed, playerSides);
+        if (ready.size() < tasks.size()) { // unwrap into a larger ring
+            vector<uint32_t> grown(max<size_t>(16, ready.size() * 2));
+            for (size_t i = 0;i < readyLen;i++) grown[i] = ready[(readyHead + i) % ready.size()];
+            ready.swap(grown);
+            readyHead = 0;
+        }
+        pushReady(uint32_t(tasks.size() - 1));
+        unfinished++;
+        return uint32_t(tasks.size() - 1);
+    }
+
+    // wakes a task parked for input; false if it was not waiting or the move is illegal
+    bool submit(uint32_t id, BattleInput in) {
+        if (id >= tasks.size() || !tasks[id].provide(in)) return false;
+        pushReady(id);
+        return true;
+    }
+
+    // runs up to `slices` ready slices; returns how many ran (0: everything is parked or done)
+    size_t poll(size_t slices = SIZE_MAX) {
+        size_t ran = 0;
+        for (;ran < slices && readyLen;ran++) {
+            uint32_t id = ready[readyHead];
+            readyHead = (readyHead + 1) % ready.size();
+            readyLen--;
+            BattleTask::State s = tasks[id].resume(logger, turnsPerSlice);
+            if (s == BattleTask::READY) { pushReady(id); continue; }
+            if (s == BattleTask::FINISHED) unfinished--;
+            if (onSuspend) onSuspend(id, tasks[id]);
+        }
+        return ran;
+    }
+
+    const BattleTask& task(uint32_t id) const { return tasks[id]; }
+    size_t size() const { return tasks.size(); }
+    size_t live() const { return unfinished; }
+    size_t readyCount() const { return readyLen; }
+
+private:
+    void pushReady(uint32_t id) {
+        ready[(readyHead + readyLen) % ready.size()] = id;
+        readyLen++;
+    }
+};
+
+/* --------------------- ReplayReader (memory-mapped replay log) ---------------------
+   Maps the whole log, indexes battle blocks by hopping over their headers, and can rebuild
+   the final state of any battle from its initial HP and events without re-simulating it.
+*/
+struct ReplaySummary {
+    BattleResult result;        // outcome / damage totals reconstructed from the events
+    vector<int> finalHp;        // A members then B members
+    bool consistent = false;    // events agree with each other and with the recorded header
+};
+
+class ReplayReader {
+    MappedFile file;
+    vector<size_t> offsets; // start of each battle block
+public:
+    struct BattleView {
+        ReplayBattleHeader header; // copied: blocks are only 4-byte aligned in the file
+        const uint16_t* initialHp;
+        const uint32_t* events;
+    };
+
+    bool open(const string& path) {
+        offsets.clear();
+        if (!file.open(path) || file.size() < sizeof(ReplayFileHeader)) return false;
+        const ReplayFileHeader* fh = reinterpret_cast<const ReplayFileHeader*>(file.data());
+        if (memcmp(fh->magic, "LBRP", 4) != 0 || fh->version != ReplayWriter::version) return false;
+        size_t pos = sizeof(ReplayFileHeader);
+        while (pos + sizeof(ReplayBattleHeader) <= file.size()) {
+            size_t next = pos + blockSize(headerAt(pos));
+            if (next > file.size()) break; // truncated tail (writer still appending)
+            offsets.push_back(pos);
+            pos = next;
+        }
+        return true;
+    }
+
+    size_t battleCount() const { return offsets.size(); }
+
+    BattleView battle(size_t i) const {
+        const unsigned char* p = file.data() + offsets[i];
+        ReplayBattleHeader h = headerAt(offsets[i]);
+        const uint16_t* hp = reinterpret_cast<const uint16_t*>(p + sizeof(ReplayBattleHeader));
+        return { h, hp, reinterpret_cast<const uint32_t*>(hp + paddedMembers(h)) };
+    }
+
+    ReplaySummary rebuild(size_t i) const {
+        BattleView v = battle(i);
+        const ReplayBattleHeader& h = v.header;
+        ReplaySummary s;
+        s.finalHp.assign(v.initialHp, v.initialHp + h.sizeA + h.sizeB);
+        auto index = [&](uint32_t slot) { return slot < 32 ? slot : h.sizeA + (slot - 32); };
+        auto valid = [&](uint32_t slot) { return slot < 32 ? slot < h.sizeA : slot - 32 < h.sizeB; };
+        bool ok = true;
+        for (uint32_t k = 0;k < h.eventCount && ok;k++) {
+            uint32_t e = v.events[k];
+            uint32_t from = ReplayEvent::actor(e), to = ReplayEvent::target(e);
+            ok = valid(from) && valid(to);
+            if (!ok) break;
+            if (ReplayEvent::kind(e) == ReplayEvent::DEATH) {
+                ok = s.finalHp[index(to)] == 0;
+                continue;
+            }
+            ok = s.finalHp[index(from)] > 0 && (from < 32) != (to < 32); // living attacker, enemy target
+            int dmg = ReplayEvent::damage(e);
+            int& hp = s.finalHp[index(to)];
+            bool wasAlive = hp > 0;
+            hp = max(0, hp - dmg);
+            if (from < 32) s.result.damageByA += dmg; else s.result.damageByB += dmg;
+            // a kill must be followed by its DEATH event
+            if (wasAlive && hp == 0)
+                ok = ok && k + 1 < h.eventCount && ReplayEvent::kind(v.events[k + 1]) == ReplayEvent::DEATH
+                && ReplayEvent::target(v.events[k + 1]) == to;
+        }
+        auto wiped = [&](size_t from, size_t n) {
+            for (size_t m = from;m < from + n;m++) if (s.finalHp[m] > 0) return false;
+            return true;
+        };
+        bool deadA = wiped(0, h.sizeA), deadB = wiped(h.sizeA, h.sizeB);
+        s.result.outcome = deadA == deadB ? BattleResult::DRAW : deadA ? BattleResult::B_WINS : BattleResult::A_WINS;
+        s.result.turns = h.turns;
+        s.consistent = ok && s.result.outcome == BattleResult::Outcome(h.outcome);
+        return s;
+    }
+
+private:
+    ReplayBattleHeader headerAt(size_t pos) const {
+        ReplayBattleHeader h;
+        memcpy(&h, file.data() + pos, sizeof h);
+        return h;
+    }
+    static size_t paddedMembers(const ReplayBattleHeader& h) { return (size_t(h.sizeA) + h.sizeB + 1) & ~size_t(1); }
+    static size_t blockSize(const ReplayBattleHeader& h) {
+        return sizeof(ReplayBattleHeader) + paddedMembers(h) * sizeof(uint16_t) + size_t(h.eventCount) * sizeof(uint32_t);
+    }
+};
+
+/* --------------------- TimelineBattle (event-driven scheduler) ---------------------
+   Characters act on a shared clock instead of in lock-step turns: each one acts every
+   1000 / speed ticks, so faster characters act more often. Pending actions sit in a min-heap
+   ordered by (time, sequence); entries of characters that died meanwhile are dropped when popped.
+   The scheduler owns the per-battle resources: mana (regenerated with elapsed time) and a
+   ready time per skill. On its action a character casts its strongest affordable, ready skill
+   and otherwise attacks. Living members of each side are kept in a swap-remove array, so
+   picking a target and detecting a wipe are O(1).
+*/
+struct TimelineConfig {
+    size_t maxActions = 200; // the battle is a draw after this many actions
+    int manaRegen = 10;      // mana regained per 1000 ticks
+    bool useSkills = true;   // false: basic attacks only
+};
+
+class TimelineBattle {
+    struct Action {
+        uint64_t time;
+        uint32_t seq;
+        uint32_t who;
+    };
+    struct Later {
+        bool operator()(const Action& x, const Action& y) const { return x.time != y.time ? x.time > y.time : x.seq > y.seq; }
+    };
+    struct Combatant {
+        Character* c;
+        int side;
+        uint32_t slot;       // replay slot
+        uint32_t interval;   // ticks between two actions
+        int64_t manaMilli;   // mana * 1000, so regeneration keeps fractional ticks
+        int64_t maxManaMilli;
+        uint64_t lastAction;
+        uint32_t firstSkill; // into readyAt
+        uint32_t aliveAt;    // position in alive[side]
+    };
+
+    Logger& logger;
+    TimelineConfig cfg;
+    ReplayWriter* replay = nullptr;
+    uint64_t nextBattleId = 0;
+    // per-battle state, kept between battles so steady-state runs do not allocate
+    vector<Combatant> fighters;
+    vector<uint64_t> readyAt;
+    vector<uint32_t> alive[2];
+    vector<Action> queue;
+    uint32_t seq = 0;
+public:
+    TimelineBattle(Logger& log, TimelineConfig c = TimelineConfig()) : logger(log), cfg(c) {}
+
+    void setReplay(ReplayWriter* w) { replay = w; }
+
+    BattleResult simulate(Party& a, Party& b) { return run(a, b, nullopt); }
+    BattleResult simulate(Party& a, Party& b, uint64_t seed) {
+        SeededRngScope rng(seed);
+        return run(a, b, seed);
+    }
+
+private:
+    BattleResult run(Party& a, Party& b, optional<uint64_t> seed) {
+        if (replay) replay->beginBattle(nextBattleId++, seed, a, b);
+        BattleResult res = fight(a, b);
+        if (replay) replay->endBattle(res);
+        return res;
+    }
+
+    void setup(Party& a, Party& b) {
+        fighters.clear();
+        readyAt.clear();
+        alive[0].clear();
+        alive[1].clear();
+        queue.clear();
+        seq = 0;
+        Party* sides[2] = { &a, &b };
+        for (int side = 0; side < 2; side++) {
+            for (size_t i = 0;i < sides[side]->size();i++) {
+                Character* c = sides[side]->getMember(i);
+                if (!c) continue;
+                Combatant f;
+                f.c = c;
+                f.side = side;
+                f.slot = ReplayEvent::slot(side, i);
+                f.interval = uint32_t(1000 / max(1, c->getSpeed()));
+                f.manaMilli = f.maxManaMilli = int64_t(c->getMana()) * 1000;
+                f.lastAction = 0;
+                f.firstSkill = uint32_t(readyAt.size());
+                f.aliveAt = 0;
+                readyAt.resize(readyAt.size() + c->skillCount(), 0);
+                uint32_t id = uint32_t(fighters.size());
+                fighters.push_back(f);
+                if (c->getHP() > 0) {
+                    fighters[id].aliveAt = uint32_t(alive[side].size());
+                    alive[side].push_back(id);
+                    schedule(id, f.interval);
+                }
+            }
+        }
+    }
+
+    void schedule(uint32_t id, uint64_t time) {
+        queue.push_back(Action{ time, seq++, id });
+        push_heap(queue.begin(), queue.end(), Later());
+    }
+
+    void markDead(uint32_t id) {
+        Combatant& f = fighters[id];
+        vector<uint32_t>& set = alive[f.side];
+        uint32_t last = set.back();
+        set[f.aliveAt] = last;
+        fighters[last].aliveAt = f.aliveAt;
+        set.pop_back();
+    }
+
+    // strongest castable skill that is ready and affordable, or SIZE_MAX to attack instead
+    size_t pickSkill(const Combatant& f, uint64_t now) const {
+        size_t best = SIZE_MAX;
+        int bestPower = INT_MIN;
+        for (size_t k = 0;k < f.c->skillCount();k++) {
+            const Skill* s = f.c->getSkill(k);
+            if (!s || !s->castable() || readyAt[f.firstSkill + k] > now) continue;
+            if (int64_t(f.c->skillCost(*s)) * 1000 > f.manaMilli) continue;
+            int p = s->effectivePower();
+            if (p > bestPower) { bestPower = p; best = k; }
+        }
+        return best;
+    }
+
+    BattleResult fight(Party& a, Party& b) {
+        BattleResult res;
+        logger.emit(Logger::INFO, [] { return LogEvent::text(Logger::INFO, "Battle starts between two parties!"); });
+        setup(a, b);
+        size_t actions = 0;
+        while (!queue.empty() && !alive[0].empty() && !alive[1].empty() && actions < cfg.maxActions) {
+            pop_heap(queue.begin(), queue.end(), Later());
+            Action act = queue.back();
+            queue.pop_back();
+            Combatant& f = fighters[act.who];
+            if (f.c->getHP() <= 0) continue; // died after this action was scheduled
+
+            f.manaMilli = min(f.maxManaMilli, f.manaMilli + int64_t(act.time - f.lastAction) * cfg.manaRegen);
+            f.lastAction = act.time;
+
+            const vector<uint32_t>& enemies = alive[1 - f.side];
+            uint32_t targetId = enemies[size_t(rollRand()) % enemies.size()];
+            Character& target = *fighters[targetId].c;
+            int before = target.getHP();
+            size_t skill = cfg.useSkills ? pickSkill(f, act.time) : SIZE_MAX;
+            ReplayEvent::Kind kind = ReplayEvent::ATTACK;
+            if (skill == SIZE_MAX) {
+                f.c->attack(target);
+            }
+            else {
+                const Skill& s = *f.c->getSkill(skill);
+                f.manaMilli -= int64_t(f.c->skillCost(s)) * 1000;
+                readyAt[f.firstSkill + skill] = act.time + uint64_t(s.getCooldown() + 1) * f.interval;
+                f.c->Character::useSkill(skill, target); // resources are accounted above, not by the class override
+                kind = ReplayEvent::SKILL;
+            }
+            int dealt = before - target.getHP();
+            (f.side == 0 ? res.damageByA : res.damageByB) += dealt;
+            if (replay) replay->record(ReplayEvent::pack(kind, f.slot, fighters[targetId].slot, skill == SIZE_MAX ? 0 : uint32_t(skill), dealt));
+            if (target.getHP() == 0 && before > 0) {
+                markDead(targetId);
+                if (replay) replay->record(ReplayEvent::pack(ReplayEvent::DEATH, fighters[targetId].slot, fighters[targetId].slot, 0, 0));
+            }
+            schedule(act.who, act.time + f.interval);
+            actions++;
+        }
+        res.turns = actions;
+        if (alive[0].empty() != alive[1].empty()) {
+            res.outcome = alive[0].empty() ? BattleResult::B_WINS : BattleResult::A_WINS;
+            logger.emit(Logger::INFO, [&] { return LogEvent::text(Logger::INFO, alive[0].empty() ? "Party A defeated!" : "Party B defeated!"); });
+        }
+        else logger.emit(Logger::INFO, [] { return LogEvent::text(Logger::INFO, "Battle ended after max turns."); });
+        return res;
+    }
+};
+
+/* --------------------- BatchSimulator (multi-threaded Monte Carlo) ---------------------
+   Runs N independent battles of the same two party templates across worker threads.
+   Every worker clones the templates per battle, runs each battle from its own seeded RNG
+   with a silent logger, and accumulates into private stats merged once at the end.
+*/
+struct DamageHistogram {
+    static constexpr int bucketWidth = 25;
+    static constexpr size_t bucketCount = 16; // last bucket collects everything above
+    array<uint64_t, bucketCount> buckets{};
+    uint64_t samples = 0;
+    long long total = 0;
+    int minValue = INT_MAX;
+    int maxValue = 0;
+
+    void add(int v) {
+        size_t b = min(bucketCount - 1, static_cast<size_t>(max(0, v) / bucketWidth));
+        buckets[b]++;
+        samples++;
+        total += v;
+        minValue = min(minValue, v);
+        maxValue = max(maxValue, v);
+    }
+    void merge(const DamageHistogram& o) {
+        for (size_t i = 0;i < bucketCount;i++) buckets[i] += o.buckets[i];
+        samples += o.samples;
+        total += o.total;
+        minValue = min(minValue, o.minValue);
+        maxValue = max(maxValue, o.maxValue);
+    }
+    double mean() const { return samples ? double(total) / samples : 0.0; }
+    string toString() const {
+        string s = "mean " + to_string(mean()) + " min " + to_string(samples ? minValue : 0) + " max " + to_string(maxValue) + " |";
+        for (size_t i = 0;i < bucketCount;i++) s += " " + to_string(buckets[i]);
+        return s;
+    }
+};
+
+struct BatchStats {
+    uint64_t battles = 0;
+    uint64_t winsA = 0;
+    uint64_t winsB = 0;
+    uint64_t draws = 0;
+    uint64_t totalTurns = 0;
+    DamageHistogram damageByA;
+    DamageHistogram damageByB;
+
+    void add(const BattleResult& r) {
+        battles++;
+        if (r.outcome == BattleResult::A_WINS) winsA++;
+        else if (r.outcome == BattleResult::B_WINS) winsB++;
+        else draws++;
+        totalTurns += r.turns;
+        damageByA.add(r.damageByA);
+        damageByB.add(r.damageByB);
+    }
+    void merge(const BatchStats& o) {
+        battles += o.battles;
+        winsA += o.winsA;
+        winsB += o.winsB;
+        draws += o.draws;
+        totalTurns += o.totalTurns;
+        damageByA.merge(o.damageByA);
+        damageByB.merge(o.damageByB);
+    }
+    double rate(uint64_t n) const { return battles ? double(n) / battles : 0.0; }
+    double winRateA() const { return rate(winsA); }
+    double winRateB() const { return rate(winsB); }
+    double drawRate() const { return rate(draws); }
+    double meanTurns() const { return rate(totalTurns); }
+};
+
+class BatchSimulator {
+    unsigned threads;
+public:
+    // threads == 0 means one worker per hardware thread
+    BatchSimulator(unsigned t = 0) : threads(t ? t : max(1u, thread::hardware_concurrency())) {}
+
+    unsigned threadCount() const { return threads; }
+
+    BatchStats run(const Party& a, const Party& b, uint64_t battles, uint64_t seed) const {
+        unsigned workers = static_cast<unsigned>(min<uint64_t>(threads, max<uint64_t>(1, battles)));
+        vector<BatchStats> partial(workers);
+        vector<thread> pool;
+        pool.reserve(workers);
+        for (unsigned w = 0;w < workers;w++) {
+            uint64_t begin = battles * w / workers;
+            uint64_t end = battles * (w + 1) / workers;
+            pool.emplace_back([&, w, begin, end] { runRange(a, b, begin, end, seed, partial[w]); });
+        }
+        BatchStats total;
+        for (unsigned w = 0;w < workers;w++) {
+            pool[w].join();
+            total.merge(partial[w]);
+        }
+        return total;
+    }
+
+private:
+    // battle i always runs from mixSeed(seed, i), so totals do not depend on the thread count
+    static void runRange(const Party& a, const Party& b, uint64_t begin, uint64_t end, uint64_t seed, BatchStats& out) {
+        Logger quiet(Logger::OFF);
+        BattleSimulator sim(quiet);
+        BatchStats local;
+        for (uint64_t i = begin;i < end;i++) {
+            Party pa = a.clone(quiet);
+            Party pb = b.clone(quiet);
+            local.add(sim.simulate(pa, pb, mixSeed(seed, i)));
+        }
+        out = local;
+    }
+};
+
+/* --------------------- WorkStealingPool (per-worker task queues) ---------------------
+   Runs task indices [0, count) on a fixed set of threads. Each worker owns a queue seeded with
+   a contiguous share of the tasks and takes from its back; a worker that runs dry steals from
+   the front of the other queues, so uneven tasks (long battles, big parties) balance out.
+   Queues are guarded per worker, never by one shared lock.
+*/
+class WorkStealingPool {
+    unsigned threads;
+
+    struct Queue {
+        mutex m;
+        vector<uint32_t> tasks;
+        size_t head = 0; // thieves take from here, the owner from the back
+        bool popBack(uint32_t& t) {
+            lock_guard<mutex> lock(m);
+            if (head == tasks.size()) return false;
+            t = tasks.back();
+            tasks.pop_back();
+            return true;
+        }
+        bool steal(uint32_t& t) {
+            lock_guard<mutex> lock(m);
+            if (head == tasks.size()) return false;
+            t = tasks[head++];
+            return true;
+        }
+    };
+public:
+    // threads == 0 means one worker per hardware thread
+    explicit WorkStealingPool(unsigned t = 0) : threads(t ? t : max(1u, thread::hardware_concurrency())) {}
+
+    unsigned threadCount() const { return threads; }
+
+    // body(task, worker) is called at most once per task, exactly once unless a call throws;
+    // returns the number of steals. A throwing call stops the workers from taking more tasks,
+    // and run() rethrows the first exception once every worker has joined.
+    template<typename F>
+    uint64_t run(uint32_t count, F&& body) const {
+        unsigned workers = static_cast<unsigned>(min<uint64_t>(threads, max<uint32_t>(1, count)));
+        vector<Queue> queues(workers);
+        for (unsigned w = 0;w < workers;w++) {
+            uint32_t begin = uint32_t(uint64_t(count) * w / workers), end = uint32_t(uint64_t(count) * (w + 1) / workers);
+            // reversed so the owner starts with its lowest index and thieves take the far end
+            for (uint32_t t = end;t > begin;t--) queues[w].tasks.push_back(t - 1);
+        }
+        atomic<uint64_t> steals{ 0 };
+        atomic<bool> failed{ false };
+        mutex errorMutex;
+        exception_ptr error;
+        auto call = [&](uint32_t t, unsigned w) {
+            try { body(t, w); }
+            catch (...) {
+                lock_guard<mutex> lock(errorMutex);
+                if (!error) error = current_exception();
+                failed.store(true, memory_order_relaxed);
+            }
+        };
+        auto work = [&](unsigned w) {
+            uint32_t t;
+            while (!failed.load(memory_order_relaxed)) {
+                if (queues[w].popBack(t)) { call(t, w); continue; }
+                bool found = false;
+                for (unsigned k = 1;k < workers && !found;k++)
+                    found = queues[(w + k) % workers].steal(t);
+                if (!found) return; // tasks are never added, so empty everywhere means done
+                steals.fetch_add(1, memory_order_relaxed);
+                call(t, w);
+            }
+        };
+        vector<thread> pool;
+        pool.reserve(workers - 1);
+        for (unsigned w = 1;w < workers;w++) pool.emplace_back(work, w);
+        work(0);
+        for (auto& th : pool) th.join();
+        if (error) rethrow_exception(error);
+        return steals.load();
+    }
+};
+
+/* --------------------- Tournament (round-robin over a roster of parties) ---------------------
+   Every unordered pair of roster entries plays `battlesPerPairing` seeded battles as one pool
+   task; sides alternate between battles so neither entry always opens. Each task writes only
+   its own PairingResult slot, and tables are folded from those slots after the pool joins, so
+   the results are identical for any thread count.
+*/
+struct TournamentConfig {
+    uint32_t battlesPerPairing = 10;
+    uint64_t seed = 1;
+    unsigned threads = 0;     // 0: hardware concurrency
+    bool timeline = false;    // TimelineBattle instead of the lock-step BattleSimulator
+    double eloK = 16.0;
+};
+
+struct PairingResult {
+    uint32_t first = 0, second = 0; // roster indices, first < second
+    uint32_t winsFirst = 0, winsSecond = 0, draws = 0;
+    uint64_t turns = 0;
+};
+
+struct TournamentReport {
+    size_t entrants = 0;
+    vector<PairingResult> pairings;
+    vector<uint32_t> winMatrix;   // winMatrix[i * entrants + j]: battles i won against j
+    vector<double> elo;
+    uint64_t battles = 0;
+    uint64_t steals = 0;
+    double seconds = 0;
+
+    uint32_t wins(size_t i, size_t j) const { return winMatrix[i * entrants + j]; }
+    double battlesPerSecond() const { return seconds > 0 ? battles / seconds : 0.0; }
+    // roster indices sorted by descending rating
+    vector<size_t> ranking() const {
+        vector<size_t> order(entrants);
+        for (size_t i = 0;i < entrants;i++) order[i] = i;
+        stable_sort(order.begin(), order.end(), [&](size_t x, size_t y) { return elo[x] > elo[y]; });
+        return order;
+    }
+};
+
+class Tournament {
+    TournamentConfig cfg;
+public:
+    Tournament(TournamentConfig c = TournamentConfig()) : cfg(c) {}
+
+    TournamentReport run(const vector<Party>& roster) const {
+        TournamentReport rep;
+        rep.entrants = roster.size();
+        for (uint32_t i = 0;i < roster.size();i++)
+            for (uint32_t j = i + 1;j < roster.size();j++) {
+                PairingResult p;
+                p.first = i;
+                p.second = j;
+                rep.pairings.push_back(p);
+            }
+        WorkStealingPool pool(cfg.threads);
+        auto t0 = chrono::steady_clock::now();
+        rep.steals = pool.run(uint32_t(rep.pairings.size()), [&](uint32_t task, unsigned) { play(roster, task, rep.pairings[task]); });
+        rep.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        tabulate(rep);
+        return rep;
+    }
+
+private:
+    void play(const vector<Party>& roster, uint32_t task, PairingResult& out) const {
+        Logger quiet(Logger::OFF);
+        BattleSimulator lockstep(quiet);
+        TimelineBattle timeline(quiet);
+        for (uint32_t k = 0;k < cfg.battlesPerPairing;k++) {
+            bool swap = k % 2 == 1;
+            Party pa = roster[swap ? out.second : out.first].clone(quiet);
+            Party pb = roster[swap ? out.first : out.second].clone(quiet);
+            uint64_t seed = mixSeed(mixSeed(cfg.seed, task), k);
+            BattleResult r = cfg.timeline ? timeline.simulate(pa, pb, seed) : lockstep.simulate(pa, pb, seed);
+            out.turns += r.turns;
+            if (r.outcome == BattleResult::DRAW) out.draws++;
+            else if ((r.outcome == BattleResult::A_WINS) != swap) out.winsFirst++;
+            else out.winsSecond++;
+        }
+    }
+
+    // pairings are folded in roster order, so ratings do not depend on completion order
+    void tabulate(TournamentReport& rep) const {
+        size_t n = rep.entrants;
+        rep.winMatrix.assign(n * n, 0);
+        rep.elo.assign(n, 1500.0);
+        for (const PairingResult& p : rep.pairings) {
+            rep.winMatrix[p.first * n + p.second] += p.winsFirst;
+            rep.winMatrix[p.second * n + p.first] += p.winsSecond;
+            uint32_t games = p.winsFirst + p.winsSecond + p.draws;
+            rep.battles += games;
+            double expected = 1.0 / (1.0 + pow(10.0, (rep.elo[p.second] - rep.elo[p.first]) / 400.0));
+            double delta = cfg.eloK * ((p.winsFirst + 0.5 * p.draws) - games * expected);
+            rep.elo[p.first] += delta;
+            rep.elo[p.second] -= delta;
+        }
+    }
+};
+
+/* --------------------- BattleState (forkable battle snapshot for search) ---------------------
+   A battle in progress as one flat block: per-fighter stats and class state, per-skill
+   cooldowns, the turn counter and the RNG position. What cannot change during a battle (class,
+   skill powers, costs and cooldown lengths) lives in a BattleRules shared by every fork, so
+   fork() is a plain copy of the block and never allocates. The rules mirror Character::attack,
+   the Warrior and Archer overrides and ActiveSkill/UltimateSkill::apply (same rolls, same
+   order); turns alternate as in BattleSimulator, but the side to move chooses its actor,
+   ability and target instead of rolling for them. Casting costs Character::skillCost mana and
+   respects cooldowns counted in the caster's own actions.
+*/
+struct BattleAction {
+    uint8_t actor = 0;   // fighter index (side A first)
+    uint8_t ability = 0; // 0: basic attack, k + 1: skill k
+    uint8_t target = 0;
+    uint32_t code() const { return uint32_t(actor) << 16 | uint32_t(ability) << 8 | target; }
+    bool operator==(const BattleAction& o) const { return code() == o.code(); }
+};
+
+struct BattleRules {
+    static constexpr size_t maxFighters = 16, maxPerSide = 8, maxSkills = 4, maxTurns = 50;
+    static constexpr size_t maxActions = maxPerSide * (1 + maxSkills) * maxPerSide;
+    enum Class : uint8_t { BASE, WARRIOR, MAGE, ARCHER }; // BASE: plain Character::attack
+    enum SkillKind : uint8_t { ACTIVE, ULTIMATE };
+    struct Fighter {
+        Class cls;
+        uint8_t skillCount; // castable skills only (passives have no combat effect)
+        int agility;
+        SkillKind kind[maxSkills];
+        int power[maxSkills], cost[maxSkills], cooldown[maxSkills];
+    };
+    size_t sizeA = 0, sizeB = 0;
+    array<Fighter, maxFighters> fighters{};
+
+    size_t size() const { return sizeA + sizeB; }
+    int side(size_t f) const { return f < sizeA ? 0 : 1; }
+
+    // fails (nullopt) for parties over maxPerSide or a member with more than maxSkills castable skills
+    static optional<BattleRules> fromParties(const Party& a, const Party& b) {
+        if (a.size() > maxPerSide || b.size() > maxPerSide) return nullopt;
+        BattleRules r;
+        r.sizeA = a.size();
+        r.sizeB = b.size();
+        for (size_t i = 0;i < r.size();i++) {
+            const Character& c = *(i < r.sizeA ? a.getMember(i) : b.getMember(i - r.sizeA));
+            Fighter& f = r.fighters[i];
+            f.cls = dynamic_cast<const Warrior*>(&c) ? WARRIOR : dynamic_cast<const Mage*>(&c) ? MAGE
+                : dynamic_cast<const Archer*>(&c) ? ARCHER : BASE;
+            if (auto ar = dynamic_cast<const Archer*>(&c)) f.agility = ar->getAgility();
+            for (size_t k = 0;k < c.skillCount();k++) {
+                const Skill* s = c.getSkill(k);
+                if (!s || !s->castable()) continue;
+                if (f.skillCount == maxSkills) return nullopt;
+                uint8_t n = f.skillCount++;
+                f.kind[n] = dynamic_cast<const UltimateSkill*>(s) ? ULTIMATE : ACTIVE;
+                f.power[n] = s->effectivePower();
+                f.cost[n] = c.skillCost(*s);
+                f.cooldown[n] = s->getCooldown();
+            }
+        }
+        return r;
+    }
+};
+
+class BattleState {
+    struct Fighter {
+        int hp, mana, attackPower, defense, level, rage;
+        uint32_t actions;                              // own actions so far (cooldown clock)
+        uint32_t readyAt[BattleRules::maxSkills];
+    };
+    const BattleRules* rules;
+    array<Fighter, BattleRules::maxFighters> fighters;
+    uint8_t alive[2][BattleRules::maxPerSide]; // living fighters per side, swap-removed on death
+    uint8_t aliveCount[2] = { 0, 0 };
+    int startHp[2] = { 0, 0 };
+    uint32_t turn = 0;
+    CounterRng rng;
+public:
+    // rules must outlive the state and all of its forks
+    BattleState(const BattleRules& r, const Party& a, const Party& b, uint64_t seed) : rules(&r), fighters{}, alive{}, rng(seed) {
+        for (size_t i = 0;i < r.size();i++) {
+            const Character& c = *(i < r.sizeA ? a.getMember(i) : b.getMember(i - r.sizeA));
+            Fighter& f = fighters[i];
+            f.hp = c.getHP(); f.mana = c.getMana(); f.attackPower = c.getAttackPower(); f.defense = c.getDefense(); f.level = c.getLevel();
+            if (auto w = dynamic_cast<const Warrior*>(&c)) f.rage = w->getRage();
+            int side = r.side(i);
+            startHp[side] += f.hp;
+            if (f.hp > 0) alive[side][aliveCount[side]++] = uint8_t(i);
+        }
+    }
+
+    BattleState fork() const { return *this; }
+    // fresh randomness for this fork (search must not see the real battle's future rolls)
+    void reseed(uint64_t seed) { rng = CounterRng(seed); }
+
+    int sideToMove() const { return int(turn % 2); }
+    uint32_t turnNumber() const { return turn; }
+    int hp(size_t f) const { return fighters[f].hp; }
+    size_t size() const { return rules->size(); }
+    bool sideAlive(int side) const { return aliveCount[side] > 0; }
+    bool terminal() const { return turn >= BattleRules::maxTurns || !sideAlive(0) || !sideAlive(1); }
+    // 1 win, 0.5 draw, 0 loss for `side`, judged as BattleSimulator does once the battle stops
+    double score(int side) const {
+        bool a = sideAlive(0), b = sideAlive(1);
+        if (a == b) return 0.5;
+        return (a ? 0 : 1) == side ? 1.0 : 0.0;
+    }
+    // search reward: the outcome once decided, otherwise 0.5 moved by the remaining-HP balance
+    double evaluate(int side) const {
+        if (sideAlive(0) != sideAlive(1)) return score(side);
+        double share[2];
+        for (int s = 0;s < 2;s++) {
+            int left = 0;
+            for (size_t i = 0;i < aliveCount[s];i++) left += fighters[alive[s][i]].hp;
+            share[s] = startHp[s] ? double(left) / startHp[s] : 0.0;
+        }
+        return 0.5 + 0.5 * (share[side] - share[1 - side]);
+    }
+
+    bool legal(const BattleAction& act) const {
+        if (act.actor >= size() || act.target >= size() || rules->side(act.actor) != sideToMove() || rules->side(act.target) == sideToMove()) return false;
+        const BattleRules::Fighter& r = rules->fighters[act.actor];
+        const Fighter& f = fighters[act.actor];
+        if (f.hp <= 0 || fighters[act.target].hp <= 0) return false;
+        if (act.ability == 0) return true;
+        size_t k = act.ability - 1u;
+        return k < r.skillCount && f.readyAt[k] <= f.actions && f.mana >= r.cost[k];
+    }
+
+    // legal() for many actions of the same turn: the state reduced to bit masks once, so each
+    // check is a few bit tests (MCTS re-checks every stored child in every sampled state)
+    struct Legality {
+        uint32_t movers = 0, targets = 0;          // living fighters of the side to move / the other side
+        uint8_t castable[BattleRules::maxFighters]; // bit k: skill k is ready and affordable
+        bool allows(const BattleAction& act) const {
+            return (movers >> act.actor & 1u) && (targets >> act.target & 1u)
+                && (act.ability == 0 || (castable[act.actor] >> (act.ability - 1u) & 1u));
+        }
+    };
+    Legality legality() const {
+        Legality l;
+        int side = sideToMove();
+        for (size_t i = 0;i < aliveCount[side];i++) {
+            uint8_t a = alive[side][i], mask = 0;
+            l.movers |= 1u << a;
+            const BattleRules::Fighter& r = rules->fighters[a];
+            for (size_t k = 0;k < r.skillCount;k++)
+                if (fighters[a].readyAt[k] <= fighters[a].actions && fighters[a].mana >= r.cost[k]) mask |= uint8_t(1u << k);
+            l.castable[a] = mask;
+        }
+        for (size_t i = 0;i < aliveCount[1 - side];i++) l.targets |= 1u << alive[1 - side][i];
+        return l;
+    }
+
+    // writes the legal actions into out (room for BattleRules::maxActions); returns their count
+    size_t legalActions(BattleAction* out) const {
+        size_t n = 0;
+        int side = sideToMove();
+        for (size_t a = 0;a < size();a++) {
+            if (rules->side(a) != side || fighters[a].hp <= 0) continue;
+            for (size_t ab = 0;ab <= rules->fighters[a].skillCount;ab++)
+                for (size_t t = 0;t < size();t++) {
+                    BattleAction act{ uint8_t(a), uint8_t(ab), uint8_t(t) };
+                    if (rules->side(t) != side && legal(act)) out[n++] = act;
+                }
+        }
+        return n;
+    }
+
+    // applies a legal action for the side to move and passes the turn; returns the HP removed
+    int apply(const BattleAction& act) {
+        const BattleRules::Fighter& r = rules->fighters[act.actor];
+        Fighter& f = fighters[act.actor];
+        Fighter& t = fighters[act.target];
+        int before = t.hp;
+        if (act.ability == 0) attack(r, f, t);
+        else {
+            size_t k = act.ability - 1u;
+            f.mana -= r.cost[k];
+            f.readyAt[k] = f.actions + uint32_t(r.cooldown[k]) + 1;
+            int dmg = r.kind[k] == BattleRules::ULTIMATE ? max(5, r.power[k] - t.defense)
+                : max(1, r.power[k] + roll() % 5 - t.defense);
+            hit(t, dmg);
+        }
+        f.actions++;
+        turn++;
+        if (before > 0 && t.hp == 0) bury(act.target);
+        return before - t.hp;
+    }
+
+    // uniformly random legal action without enumerating the whole action list: every (actor,
+    // ability) pair has the same targets, so a uniform pair and a uniform target are uniform overall
+    BattleAction randomAction() {
+        int side = sideToMove();
+        uint64_t bits = rng.next64(); // two 21-bit draws: (actor, ability) pair, target
+        uint32_t options[BattleRules::maxPerSide], total = 0;
+        for (size_t i = 0;i < aliveCount[side];i++) {
+            options[i] = usableSkills(alive[side][i], nullptr) + 1;
+            total += options[i];
+        }
+        uint32_t pick = below(uint32_t(bits), total);
+        size_t i = 0;
+        for (;pick >= options[i];i++) pick -= options[i];
+        BattleAction act;
+        act.actor = alive[side][i];
+        act.target = alive[1 - side][below(uint32_t(bits >> 21), aliveCount[1 - side])];
+        uint8_t usable[BattleRules::maxSkills];
+        usableSkills(act.actor, usable);
+        act.ability = pick == 0 ? 0 : uint8_t(usable[pick - 1] + 1);
+        return act;
+    }
+
+    // random playout for at most `horizon` turns (to the end by default); returns evaluate(side)
+    double playout(int side, uint32_t horizon = UINT32_MAX) {
+        for (uint32_t t = 0;t < horizon && !terminal();t++) apply(randomAction());
+        return evaluate(side);
+    }
+
+private:
+    int roll() { return rng.roll(); }
+    // skills fighter a can cast now, written to out (when given); returns their count
+    uint32_t usableSkills(size_t a, uint8_t* out) const {
+        const BattleRules::Fighter& r = rules->fighters[a];
+        const Fighter& f = fighters[a];
+        uint32_t n = 0;
+        for (size_t k = 0;k < r.skillCount;k++)
+            if (f.readyAt[k] <= f.actions && f.mana >= r.cost[k]) {
+                if (out) out[n] = uint8_t(k);
+                n++;
+            }
+        return n;
+    }
+    // maps 21 random bits onto [0, n) by multiply-shift (no division)
+    static uint32_t below(uint32_t bits, uint32_t n) { return ((bits & 0x1FFFFFu) * n) >> 21; }
+
+    static void hit(Fighter& t, int dmg) { t.hp = max(0, t.hp - dmg); }
+
+    void bury(uint8_t f) {
+        int side = rules->side(f);
+        uint8_t* list = alive[side];
+        for (uint8_t i = 0;i < aliveCount[side];i++)
+            if (list[i] == f) { list[i] = list[--aliveCount[side]]; return; }
+    }
+
+    void attack(const BattleRules::Fighter& r, Fighter& f, Fighter& t) {
+        if (r.cls == BattleRules::WARRIOR) f.rage = min(100, f.rage + 10);
+        if (r.cls == BattleRules::ARCHER) roll(); // crit roll: the +7 is only reported, never dealt
+        int variance = roll() % (f.level + 3);
+        hit(t, max(0, f.attackPower + f.level * 2 + variance - t.defense));
+        if (r.cls == BattleRules::WARRIOR && f.rage >= 50) {
+            hit(t, 5 + f.level);
+            f.rage = 0;
+        }
+    }
+};
+
+/* --------------------- MctsPlanner (root-parallel Monte Carlo tree search) ---------------------
+   Each of `trees` independent searches runs as one WorkStealingPool task from its own RNG stream
+   and `iterationsPerTree` iterations; their root visit counts are summed and the most visited
+   action wins. Search is open-loop: every iteration forks the root, reseeds the fork and replays
+   the chosen actions, so chance is sampled rather than memorized. With a fixed tree count the
+   decision does not depend on the number of threads.
+*/
+struct MctsConfig {
+    unsigned threads = 0;        // 0: hardware concurrency
+    uint32_t trees = 4;
+    uint32_t iterationsPerTree = 1000;
+    uint32_t rolloutTurns = 16;  // truncated playouts, scored by BattleState::evaluate
+    double exploration = 1.4;
+    uint64_t seed = 1;
+};
+
+struct MctsDecision {
+    BattleAction action;
+    uint64_t rollouts = 0;
+    double seconds = 0;
+    vector<pair<BattleAction, uint32_t>> visits; // root actions summed over trees
+};
+
+class MctsPlanner {
+    MctsConfig cfg;
+
+    struct Node {
+        BattleAction action;
+        uint8_t mover = 0;      // side that played `action`
+        uint32_t firstChild = 0, childCount = 0;
+        uint32_t visits = 0;
+        double mean = 0;        // average reward for `mover`
+        double spread = 0;      // 1 / sqrt(visits), kept so UCT scores need no sqrt or division
+        bool expanded = false;
+    };
+public:
+    MctsPlanner(MctsConfig c = MctsConfig()) : cfg(c) {}
+
+    MctsDecision decide(const BattleState& root) const {
+        MctsDecision d;
+        vector<vector<pair<BattleAction, uint32_t>>> perTree(cfg.trees);
+        auto t0 = chrono::steady_clock::now();
+        WorkStealingPool(cfg.threads).run(cfg.trees, [&](uint32_t tree, unsigned) { perTree[tree] = search(root, tree); });
+        d.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        d.rollouts = uint64_t(cfg.trees) * cfg.iterationsPerTree;
+        for (auto& visits : perTree)
+            for (auto& v : visits) {
+                auto it = find_if(d.visits.begin(), d.visits.end(), [&](const pair<BattleAction, uint32_t>& e) { return e.first == v.first; });
+                if (it == d.visits.end()) d.visits.push_back(v);
+                else it->second += v.second;
+            }
+        // ties broken by action code so the merge order cannot matter
+        auto best = max_element(d.visits.begin(), d.visits.end(), [](const pair<BattleAction, uint32_t>& x, const pair<BattleAction, uint32_t>& y) {
+            return x.second != y.second ? x.second < y.second : x.first.code() > y.first.code(); });
+        if (best != d.visits.end()) d.action = best->first;
+        return d;
+    }
+
+private:
+    vector<pair<BattleAction, uint32_t>> search(const BattleState& root, uint32_t tree) const {
+        vector<Node> nodes(1);
+        nodes.reserve(size_t(cfg.iterationsPerTree) * 8);
+        vector<BattleAction> legal(BattleRules::maxActions);
+        vector<uint32_t> path;
+        uint64_t stream = mixSeed(cfg.seed, tree);
+        for (uint32_t it = 0;it < cfg.iterationsPerTree;it++) {
+            BattleState s = root.fork();
+            s.reseed(mixSeed(stream, it));
+            path.assign(1, 0);
+            uint32_t cur = 0;
+            while (!s.terminal()) {
+                if (!nodes[cur].expanded) { // expand with every action legal now
+                    size_t n = s.legalActions(legal.data());
+                    nodes[cur].firstChild = uint32_t(nodes.size());
+                    nodes[cur].childCount = uint32_t(n);
+                    nodes[cur].expanded = true;
+                    for (size_t k = 0;k < n;k++) {
+                        Node c;
+                        c.action = legal[k];
+                        c.mover = uint8_t(s.sideToMove());
+                        nodes.push_back(c);
+                    }
+                }
+                uint32_t pick = select(nodes, cur, s);
+                if (pick == UINT32_MAX) break; // nothing stored is legal in this sample
+                s.apply(nodes[pick].action);
+                path.push_back(pick);
+                cur = pick;
+                if (nodes[pick].visits == 0) break; // new leaf: roll out from here
+            }
+            double scoreA = s.playout(0, cfg.rolloutTurns);
+            for (uint32_t n : path) {
+                Node& node = nodes[n];
+                node.visits++;
+                node.mean += ((node.mover == 0 ? scoreA : 1.0 - scoreA) - node.mean) / node.visits;
+                node.spread = 1.0 / sqrt(double(node.visits));
+            }
+        }
+        vector<pair<BattleAction, uint32_t>> out;
+        for (uint32_t c = 0;c < nodes[0].childCount;c++) {
+            const Node& n = nodes[nodes[0].firstChild + c];
+            if (n.visits) out.push_back({ n.action, n.visits });
+        }
+        return out;
+    }
+
+    // UCT over the children legal in this sample; unvisited ones first
+    uint32_t select(const vector<Node>& nodes, uint32_t parent, const BattleState& s) const {
+        const Node& p = nodes[parent];
+        double explore = cfg.exploration * sqrt(log(double(max(1u, p.visits))));
+        BattleState::Legality legal = s.legality();
+        uint32_t best = UINT32_MAX;
+        double bestScore = -1;
+        for (uint32_t c = p.firstChild;c < p.firstChild + p.childCount;c++) {
+            const Node& n = nodes[c];
+            if (!legal.allows(n.action)) continue;
+            if (n.visits == 0) return c;
+            double score = n.mean + explore * n.spread;
+            if (score > bestScore) { bestScore = score; best = c; }
+        }
+        return best;
+    }
+};
+
+/* --------------------- LoadoutSolver (budgeted skill selection over a SkillTree) ---------------------
+   Picks which skills a character should unlock. A node can only be taken if its parent is; every
+   unlock costs `unlockCost` points plus the character's skillCost() for it; the picked set
+   maximizes the overallPower() contribution (effectivePower() / 2 per skill) within `budget`.
+   Tree DP over the Euler-tour order: best(i, b) is the best value of the preorder suffix from i,
+   where taking i moves on to i + 1 (its first child) and skipping i jumps past its subtree.
+   Bounds keep the table small: a row is only stored below the suffix's total cost (at or above
+   it everything fits), and nodes that cost more than the budget or head a zero-value subtree are
+   pruned with their subtree. Results are memoized per cost vector, so characters that price
+   skills the same share one solve; solveAll() spreads a roster over the WorkStealingPool.
+   Skill powers are read once at construction; build a new solver after upgrades or tree edits.
+*/
+struct LoadoutConfig {
+    int budget = 120;
+    int unlockCost = 5;   // points per unlocked skill, on top of its mana cost
+    unsigned threads = 0; // solveAll; 0: hardware concurrency
+};
+
+struct Loadout {
+    vector<SkillTreeNode*> skills; // preorder, parents before children
+    int cost = 0;
+    int power = 0;          // overallPower() gained from the picked skills
+    int projectedPower = 0; // the character's overallPower() with them equipped
+};
+
+class LoadoutSolver {
+    LoadoutConfig cfg;
+    vector<SkillTreeNode*> order;
+    vector<uint32_t> subtreeEnd;
+    vector<int> value;   // effectivePower() / 2
+    vector<int> valueAt; // prefix sums of value: subtree value is valueAt[end] - valueAt[i]
+
+    struct Memo {
+        vector<int> costs;
+        once_flag done;
+        Loadout result;
+    };
+    mutable mutex memoLock;
+    mutable unordered_map<uint64_t, vector<shared_ptr<Memo>>> memo; // by cost-vector hash
+    mutable atomic<uint64_t> solves{ 0 };
+public:
+    template<typename T>
+    explicit LoadoutSolver(const SkillTree<T>& tree, LoadoutConfig c = LoadoutConfig()) : cfg(c) {
+        eulerTour(tree.getRoot(), order, subtreeEnd);
+        value.resize(order.size());
+        valueAt.assign(order.size() + 1, 0);
+        for (size_t i = 0;i < order.size();i++) {
+            const Skill* s = order[i]->getSkill();
+            value[i] = s ? s->effectivePower() / 2 : 0;
+            valueAt[i + 1] = valueAt[i] + value[i];
+        }
+    }
+
+    Loadout solve(const Character& c) const {
+        vector<int> costs = costsFor(c);
+        uint64_t key = costs.size();
+        for (int x : costs) key = mixSeed(key, uint64_t(x));
+        shared_ptr<Memo> m;
+        {
+            lock_guard<mutex> lock(memoLock);
+            auto& bucket = memo[key];
+            for (auto& e : bucket)
+                if (e->costs == costs) { m = e; break; }
+            if (!m) {
+                m = make_shared<Memo>();
+                m->costs = move(costs);
+                bucket.push_back(m);
+            }
+        }
+        call_once(m->done, [&] { m->result = search(m->costs); solves++; });
+        Loadout out = m->result;
+        out.projectedPower = c.computeOverallPower() + out.power;
+        return out;
+    }
+
+    vector<Loadout> solveAll(const vector<const Character*>& roster) const {
+        vector<Loadout> out(roster.size());
+        WorkStealingPool(cfg.threads).run(uint32_t(roster.size()), [&](uint32_t i, unsigned) { out[i] = solve(*roster[i]); });
+        return out;
+    }
+
+    size_t size() const { return order.size(); }
+    uint64_t solveCount() const { return solves; } // DP runs; memo hits do not count
+
+private:
+    vector<int> costsFor(const Character& c) const {
+        vector<int> costs(order.size(), 0);
+        for (size_t i = 0;i < order.size();i++)
+            if (const Skill* s = order[i]->getSkill()) costs[i] = cfg.unlockCost + c.skillCost(*s);
+        return costs;
+    }
+
+    Loadout search(const vector<int>& costs) const {
+        const size_t n = order.size();
+        const int budget = max(0, cfg.budget);
+        // suffixCost[i]: cost of taking all of i..n-1, saturated at budget + 1 (= row width)
+        vector<int> suffixCost(n + 1, 0);
+        for (size_t i = n;i-- > 0;) suffixCost[i] = int(min<long long>(budget + 1, (long long)suffixCost[i + 1] + costs[i]));
+        // a pruned row is the row of the first unpruned position after its subtree
+        vector<uint32_t> row(n + 1, uint32_t(n));
+        vector<size_t> rowStart(n + 1, 0);
+        size_t cells = 0;
+        for (size_t i = n;i-- > 0;) {
+            bool pruned = costs[i] > budget || valueAt[subtreeEnd[i]] == valueAt[i];
+            row[i] = pruned ? row[subtreeEnd[i]] : uint32_t(i);
+            if (!pruned) { rowStart[i] = cells; cells += size_t(suffixCost[i]); }
+        }
+        vector<int> best(cells);
+        auto at = [&](size_t i, int b) {
+            i = row[i];
+            return b >= suffixCost[i] ? valueAt[n] - valueAt[i] : best[rowStart[i] + size_t(b)];
+        };
+        for (size_t i = n;i-- > 0;) {
+            if (row[i] != i) continue;
+            int* out = &best[rowStart[i]];
+            for (int b = 0;b < suffixCost[i];b++) {
+                int v = at(subtreeEnd[i], b);
+                if (costs[i] <= b) v = max(v, value[i] + at(i + 1, b - costs[i]));
+                out[b] = v;
+            }
+        }
+        // walk the table again, preferring to skip on ties (fewer unlocks for the same power)
+        Loadout l;
+        int b = budget;
+        for (size_t i = 0;i < n;) {
+            if (row[i] != i) { i = row[i]; continue; }
+            if (at(subtreeEnd[i], b) == at(i, b)) { i = subtreeEnd[i]; continue; }
+            l.skills.push_back(order[i]);
+            l.cost += costs[i];
+            l.power += value[i];
+            b -= costs[i];
+            i++;
+        }
+        return l;
+    }
+};
+
+/* --------------------- SoA combat engine (stat columns + SIMD damage kernels) ---------------------
+   Alternate engine for large simulations: party stats live in contiguous columns and the
+   Character::attack / ActiveSkill::apply damage formulas are evaluated for a whole volley at once.
+   The Warrior rage bonus and the Archer crit roll are applied around the shared kernel, and rolls
+   are drawn up front in the order the object path would consume them (crit roll, then variance),
+   so for the same RNG stream both paths produce identical damage for any class mix.
+*/
+struct CombatColumns {
+    enum Style : uint8_t { PLAIN, RAGE, CRIT }; // which attack() override a member uses
+
+    vector<int> hp, mana, attackPower, defense, level;
+    vector<uint8_t> style;
+    vector<int> rage, agility; // Warrior / Archer state (0 for the other classes)
+
+    size_t size() const { return hp.size(); }
+    static CombatColumns fromParty(Party& p) {
+        CombatColumns c;
+        for (size_t i = 0;i < p.size();i++) {
+            Character* m = p.getMember(i);
+            c.hp.push_back(m->getHP());
+            c.mana.push_back(m->getMana());
+            c.attackPower.push_back(m->getAttackPower());
+            c.defense.push_back(m->getDefense());
+            c.level.push_back(m->getLevel());
+            const Warrior* w = dynamic_cast<const Warrior*>(m);
+            const Archer* a = dynamic_cast<const Archer*>(m);
+            c.style.push_back(w ? RAGE : a ? CRIT : PLAIN);
+            c.rage.push_back(w ? w->getRage() : 0);
+            c.agility.push_back(a ? a->getAgility() : 0);
+        }
+        return c;
+    }
+};
+
+struct DamageKernels {
+    // dmg[i] = max(0, atk[i] + lvl[i] * 2 + roll[i] % (lvl[i] + 3) - def[i])    (Character::attack)
+    static void attack(const int* atk, const int* lvl, const int* def, const int* roll, int* dmg, size_t n) {
+        size_t i = 0;
+#ifdef LAB_SIMD_SSE2
+        const __m128i three = _mm_set1_epi32(3), zero = _mm_setzero_si128();
+        for (;i < (n & ~size_t(3));i += 4) {
+            __m128i l = load(lvl + i);
+            __m128i raw = _mm_add_epi32(load(atk + i), _mm_add_epi32(l, l));
+            __m128i v = _mm_add_epi32(raw, mod(load(roll + i), _mm_add_epi32(l, three)));
+            v = _mm_sub_epi32(v, load(def + i));
+            store(dmg + i, _mm_and_si128(v, _mm_cmpgt_epi32(v, zero)));
+        }
+#endif
+        for (;i < n;i++) dmg[i] = max(0, atk[i] + lvl[i] * 2 + roll[i] % (lvl[i] + 3) - def[i]);
+    }
+
+    // dmg[i] = max(1, power[i] + roll[i] % 5 - def[i])                          (ActiveSkill::apply)
+    static void activeSkill(const int* power, const int* def, const int* roll, int* dmg, size_t n) {
+        size_t i = 0;
+#ifdef LAB_SIMD_SSE2
+        const __m128i five = _mm_set1_epi32(5), one = _mm_set1_epi32(1);
+        for (;i < (n & ~size_t(3));i += 4) {
+            __m128i v = _mm_sub_epi32(_mm_add_epi32(load(power + i), mod(load(roll + i), five)), load(def + i));
+            __m128i keep = _mm_cmpgt_epi32(v, one);
+            store(dmg + i, _mm_or_si128(_mm_and_si128(keep, v), _mm_andnot_si128(keep, one)));
+        }
+#endif
+        for (;i < n;i++) dmg[i] = max(1, power[i] + roll[i] % 5 - def[i]);
+    }
+
+private:
+#ifdef LAB_SIMD_SSE2
+    static __m128i load(const int* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static void store(int* p, __m128i v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+    // r % d for 0 <= r < 2^31, d > 0 (SSE2 has no integer divide). The double quotient is
+    // exact enough that truncation never crosses an integer boundary, so this is bit-exact.
+    static __m128i mod(__m128i r, __m128i d) {
+        __m128i rHi = _mm_shuffle_epi32(r, _MM_SHUFFLE(1, 0, 3, 2));
+        __m128i dHi = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+        __m128i lo = mod2(_mm_cvtepi32_pd(r), _mm_cvtepi32_pd(d));
+        __m128i hi = mod2(_mm_cvtepi32_pd(rHi), _mm_cvtepi32_pd(dHi));
+        return _mm_unpacklo_epi64(lo, hi);
+    }
+    static __m128i mod2(__m128d r, __m128d d) {
+        __m128d q = _mm_cvtepi32_pd(_mm_cvttpd_epi32(_mm_div_pd(r, d)));
+        return _mm_cvttpd_epi32(_mm_sub_pd(r, _mm_mul_pd(q, d)));
+    }
+#endif
+};
+
+class SoACombatEngine {
+    vector<int> laneAtk, laneLvl, laneDef, lanePow, laneRoll, laneDmg; // reused scratch lanes
+    vector<uint8_t> laneCrit;
+public:
+    // one roll per action, in action order (same values as the object path's rollRand() calls)
+    static void drawRolls(vector<int>& rolls, size_t n) {
+        rolls.resize(n);
+        currentRandom().fill(rolls.data(), n);
+    }
+    // rolls for attackVolley: archers consume a crit roll before the variance roll
+    static void drawRolls(vector<int>& rolls, const CombatColumns& attackers, const vector<uint32_t>& order) {
+        size_t n = order.size();
+        for (uint32_t a : order) n += attackers.style[a] == CombatColumns::CRIT;
+        drawRolls(rolls, n);
+    }
+
+    // attacker order[i] performs its attack() on target targetIdx[i]; returns per-action damage as
+    // attack() reports it (an archer's crit +7 is reported, not dealt). Updates warrior rage.
+    const vector<int>& attackVolley(CombatColumns& attackers, CombatColumns& targets,
+        const vector<uint32_t>& order, const vector<uint32_t>& targetIdx, const vector<int>& rolls) {
+        size_t n = order.size();
+        laneAtk.resize(n); laneLvl.resize(n); laneDef.resize(n); laneRoll.resize(n); laneDmg.resize(n); laneCrit.resize(n);
+        size_t r = 0;
+        for (size_t i = 0;i < n;i++) {
+            uint32_t a = order[i];
+            laneAtk[i] = attackers.attackPower[a];
+            laneLvl[i] = attackers.level[a];
+            laneDef[i] = targets.defense[targetIdx[i]];
+            laneCrit[i] = attackers.style[a] == CombatColumns::CRIT
+                && rolls[r++] % 100 < min(50, attackers.agility[a] + attackers.level[a]);
+            laneRoll[i] = rolls[r++];
+        }
+        DamageKernels::attack(laneAtk.data(), laneLvl.data(), laneDef.data(), laneRoll.data(), laneDmg.data(), n);
+        for (size_t i = 0;i < n;i++) {
+            uint32_t a = order[i];
+            if (attackers.style[a] != CombatColumns::RAGE) continue;
+            int& rage = attackers.rage[a];
+            rage = min(100, rage + 10);
+            if (rage >= 50) {
+                laneDmg[i] += 5 + attackers.level[a];
+                rage = 0;
+            }
+        }
+        applyDamage(targets, targetIdx);
+        for (size_t i = 0;i < n;i++) laneDmg[i] += laneCrit[i] ? 7 : 0;
+        return laneDmg;
+    }
+
+    // power[i] is the caster's ActiveSkill::effectivePower(); it hits targetIdx[i]
+    const vector<int>& activeSkillVolley(const vector<int>& power, CombatColumns& targets,
+        const vector<uint32_t>& targetIdx, const vector<int>& rolls) {
+        size_t n = power.size();
+        laneDef.resize(n); laneDmg.resize(n);
+        for (size_t i = 0;i < n;i++) laneDef[i] = targets.defense[targetIdx[i]];
+        DamageKernels::activeSkill(power.data(), laneDef.data(), rolls.data(), laneDmg.data(), n);
+        applyDamage(targets, targetIdx);
+        return laneDmg;
+    }
+
+private:
+    // damage is never negative, so summing then clamping equals the sequential takeDamage() clamps
+    void applyDamage(CombatColumns& targets, const vector<uint32_t>& targetIdx) {
+        for (size_t i = 0;i < targetIdx.size();i++) targets.hp[targetIdx[i]] -= laneDmg[i];
+        for (auto& h : targets.hp) h = max(0, h);
+    }
+};
+
+/* --------------------- Helper skill factory for random generation --------------------- */
+// heap when arena is null, otherwise constructed inside the arena
+template<typename T, typename... Args>
+Skill* makeSkill(Arena* arena, Args&&... args) {
+    return arena ? static_cast<Skill*>(arena->make<T>(forward<Args>(args)...)) : new T(forward<Args>(args)...);
+}
+
+Skill* randomSkillInto(Arena* arena) {
+    static atomic<int> nextId{ 0 }; // unique names even when several threads generate at once
+    int counter = ++nextId;
+    int t = rollRand() % 3;
+    if (t == 0) return makeSkill<ActiveSkill>(arena, "Active_" + to_string(counter), 10 + (counter % 5));
+    if (t == 1) return makeSkill<PassiveSkill>(arena, "Passive_" + to_string(counter), 5 + (counter % 3));
+    return makeSkill<UltimateSkill>(arena, "Ult_" + to_string(counter), 25 + (counter % 8));
+}
+
+Skill* randomSkillFactory() { return randomSkillInto(nullptr); }
+Skill* randomSkillFactoryIn(Arena& arena) { return randomSkillInto(&arena); }
+
+/* --------------------- Parallel tree generation (seed-deterministic, multi-core) ---------------------
+   SkillTree::generateParallel builds the same tree for a seed whatever the thread count: every
+   node's child count and skill kind are pure hashes of its own key, and a child's key is a hash of
+   (parent key, child index), so no RNG state is shared or ordered between workers. The top of the
+   tree is expanded serially until `splitNodes` nodes wait in the frontier; each frontier node's
+   subtree is then a WorkStealingPool task. One parallel pass sizes the subtrees so that names
+   ("Gen_<preorder id>") are numbered without coordination, a second builds them detached into a
+   per-task Arena that the tree takes over, and the serial tail adopts them into the tree and its
+   name index. GeneratedNames interns each id's name once per process, in the serial part, so the
+   workers never take the SymbolTable lock and regenerating reuses the names already interned.
+*/
+struct TreeGenConfig {
+    int maxDepth = 12;        // the root is depth 1, as in generateRandom
+    int minChildren = 0;      // 1 or more: no branch dies out early
+    int maxChildren = 3;
+    uint64_t seed = 1;
+    unsigned threads = 0;     // 0: hardware concurrency; never changes the tree
+    size_t splitNodes = 1024; // frontier size that ends the serial top expansion
+};
+
+// statistics of one run; the generated skills belong to the tree
+struct TreeGenResult {
+    size_t nodes = 0;
+    double seconds = 0;
+    uint64_t steals = 0;
+};
+
+// "Gen_<id>" symbols for generated skills, paged like SymbolTable so reserve never moves a slot
+class GeneratedNames {
+    static constexpr size_t pageBits = 12, pageSize = size_t(1) << pageBits, maxPages = 4096;
+
+    mutex m;
+    array<atomic<Symbol*>, maxPages> pages{};
+    vector<unique_ptr<Symbol[]>> ownedPages;
+    size_t count = 1; // ids start at 1
+public:
+    static GeneratedNames& global() {
+        static GeneratedNames names;
+        return names;
+    }
+
+    // interns the names of ids [1, last] that are not interned yet
+    void reserve(size_t last) {
+        lock_guard<mutex> lock(m);
+        if (last >= maxPages * pageSize) throw length_error("GeneratedNames: too many ids");
+        for (;count <= last;count++) {
+            size_t page = count >> pageBits;
+            if (!pages[page].load(memory_order_relaxed)) {
+                ownedPages.emplace_back(new Symbol[pageSize]);
+                pages[page].store(ownedPages.back().get(), memory_order_release);
+            }
+            pages[page].load(memory_order_relaxed)[count & (pageSize - 1)] = Symbol("Gen_" + to_string(count));
+        }
+    }
+    // lock-free; the id must be covered by a reserve that happened before
+    Symbol operator[](uint32_t id) const { return pages[id >> pageBits].load(memory_order_acquire)[id & (pageSize - 1)]; }
+};
+
+class TreeShape {
+    TreeGenConfig cfg;
+public:
+    explicit TreeShape(const TreeGenConfig& c) : cfg(c) {}
+
+    static uint64_t rootKey(uint64_t seed) { return mixSeed(seed, 0); }
+    static uint64_t childKey(uint64_t key, int i) { return mixSeed(key, uint64_t(i) + 1); }
+    int children(uint64_t key, int depth) const {
+        if (depth >= cfg.maxDepth || cfg.maxChildren <= 0) return 0;
+        int lo = max(0, min(cfg.minChildren, cfg.maxChildren));
+        return lo + int(mixSeed(key, 0) % uint64_t(cfg.maxChildren - lo + 1));
+    }
+    // same kinds and powers as randomSkillInto, named after a deterministic id (already reserved)
+    static Skill* make(Arena& arena, uint64_t key, uint32_t id) {
+        Symbol name = GeneratedNames::global()[id];
+        int kind = int(mixSeed(key, UINT64_MAX) % 3);
+        if (kind == 0) return arena.make<ActiveSkill>(name, 10 + int(id % 5));
+        if (kind == 1) return arena.make<PassiveSkill>(name, 5 + int(id % 3));
+        return arena.make<UltimateSkill>(name, 25 + int(id % 8));
+    }
+
+    // strict descendants of a node, without building them
+    size_t countBelow(uint64_t key, int depth) const {
+        size_t n = 0;
+        vector<pair<uint64_t, int>> stack{ { key, depth } };
+        while (!stack.empty()) {
+            auto [k, d] = stack.back();
+            stack.pop_back();
+            int nc = children(k, d);
+            n += size_t(nc);
+            for (int i = 0;i < nc;i++) stack.push_back({ childKey(k, i), d + 1 });
+        }
+        return n;
+    }
+
+    // builds the children of (key, depth) as detached subtrees (no index), preorder ids from firstId
+    vector<unique_ptr<SkillTreeNode>> buildBelow(Arena& arena, uint64_t key, int depth, uint32_t firstId) const {
+        vector<unique_ptr<SkillTreeNode>> top;
+        struct Frame { SkillTreeNode* node; uint64_t key; int depth; int next, count; };
+        vector<Frame> stack{ { nullptr, key, depth, 0, children(key, depth) } };
+        uint32_t id = firstId;
+        while (!stack.empty()) {
+            Frame& f = stack.back();
+            if (f.next == f.count) { stack.pop_back(); continue; }
+            uint64_t k = childKey(f.key, f.next++);
+            Skill* s = make(arena, k, id++);
+            SkillTreeNode* child;
+            if (f.node) child = f.node->addChild(s);
+            else {
+                top.push_back(make_unique<SkillTreeNode>(s, nullptr));
+                child = top.back().get();
+            }
+            int d = f.depth + 1;
+            stack.push_back({ child, k, d, 0, children(k, d) }); // invalidates f
+        }
+        return top;
+    }
+};
+
+template<typename T>
+TreeGenResult SkillTree<T>::generateParallel(const TreeGenConfig& cfg) {
+    TreeGenResult res;
+    auto t0 = chrono::steady_clock::now();
+    TreeShape shape(cfg);
+    GeneratedNames& names = GeneratedNames::global();
+    auto topArena = make_unique<Arena>();
+    Arena* top = topArena.get();
+    uint32_t nextId = 1;
+    auto topSkill = [&](uint64_t key) {
+        names.reserve(nextId);
+        return TreeShape::make(*top, key, nextId++);
+    };
+    struct Pending { SkillTreeNode* node; uint64_t key; int depth; };
+    uint64_t rk = TreeShape::rootKey(cfg.seed);
+    resetRoot(topSkill(rk)); // releases the previous tree's arenas
+    arenas.push_back(move(topArena));
+    // serial BFS over the top until the frontier is wide enough to split
+    vector<Pending> frontier{ { root.get(), rk, 1 } };
+    size_t head = 0;
+    while (head < frontier.size() && frontier.size() - head < max<size_t>(1, cfg.splitNodes)) {
+        Pending p = frontier[head++];
+        int nc = shape.children(p.key, p.depth);
+        for (int i = 0;i < nc;i++) {
+            uint64_t k = TreeShape::childKey(p.key, i);
+            frontier.push_back({ p.node->addChild(topSkill(k)), k, p.depth + 1 });
+        }
+    }
+    frontier.erase(frontier.begin(), frontier.begin() + ptrdiff_t(head));
+
+    WorkStealingPool pool(cfg.threads);
+    uint32_t tasks = uint32_t(frontier.size());
+    vector<size_t> sizes(tasks);
+    res.steals += pool.run(tasks, [&](uint32_t t, unsigned) { sizes[t] = shape.countBelow(frontier[t].key, frontier[t].depth); });
+    vector<uint32_t> firstId(tasks);
+    size_t total = nextId - 1;
+    for (uint32_t t = 0;t < tasks;t++) {
+        firstId[t] = uint32_t(total + 1);
+        total += sizes[t];
+    }
+    if (total >= UINT32_MAX) throw length_error("generateParallel: too many nodes");
+    names.reserve(total);
+    vector<vector<unique_ptr<SkillTreeNode>>> built(tasks);
+    vector<unique_ptr<Arena>> taskArenas(tasks);
+    res.steals += pool.run(tasks, [&](uint32_t t, unsigned) {
+        taskArenas[t] = make_unique<Arena>();
+        built[t] = shape.buildBelow(*taskArenas[t], frontier[t].key, frontier[t].depth, firstId[t]);
+        });
+    for (auto& a : taskArenas) arenas.push_back(move(a));
+    index->reserve(total);
+    for (uint32_t t = 0;t < tasks;t++)
+        for (auto& sub : built[t]) frontier[t].node->adoptChild(move(sub));
+    res.nodes = total;
+    res.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    return res;
+}
+
+/* --------------------- Workload helpers (benchmarks and self-checks) --------------------- */
+// deterministic mixed party: Warrior/Mage/Archer rotation, varied levels, one active skill each
+Party makeWorkloadParty(Logger& log, size_t n, const string& prefix) {
+    Party p(log);
+    for (size_t i = 0;i < n;i++) {
+        string nm = prefix + to_string(i);
+        unique_ptr<Character> c;
+        if (i % 3 == 0) c = make_unique<Warrior>(nm, log);
+        else if (i % 3 == 1) c = make_unique<Mage>(nm, log);
+        else c = make_unique<Archer>(nm, log);
+        for (size_t l = 0;l < i % 4;l++) c->levelUp();
+        c->equipSkill(unique_ptr<Skill>(new ActiveSkill(nm + "_strike", 10 + int(i % 7))));
+        p.addMember(move(c));
+    }
+    return p;
+}
+
+// roster of differently sized and levelled workload parties for tournaments
+vector<Party> makeWorkloadRoster(Logger& log, size_t n) {
+    vector<Party> roster;
+    for (size_t i = 0;i < n;i++) {
+        Party p = makeWorkloadParty(log, 2 + i % 5, "T" + to_string(i) + "_");
+        for (size_t l = 0;l < i % 3;l++) p.getMember(0)->levelUp();
+        roster.push_back(move(p));
+    }
+    return roster;
+}
+
+/* --------------------- Benchmarks (run with: <exe> --bench [name-filter]) ---------------------
+   Every workload uses fixed seeds. Results are printed as JSON Lines, one object per measurement:
+   {"name":..., "ops":..., "ns_per_op":..., "allocs_per_op":..., "ops_per_sec":...}
+   so runs from two commits can be diffed or loaded by a script.
+*/
+struct NullBuffer : streambuf {
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char*, streamsize n) override { return n; }
+};
+
+// keeps results observable so the optimizer cannot drop the measured work
+inline void benchKeep(long long v) {
+    static volatile long long sink;
+    sink = sink + v;
+}
+
+void benchRecord(const char* name, uint64_t ops, double ns, uint64_t allocs, const string& extra = string()) {
+    ops = max<uint64_t>(ops, 1);
+    cout << "{\"name\":\"" << name << "\",\"ops\":" << ops << ",\"ns_per_op\":" << ns / ops
+        << ",\"allocs_per_op\":" << double(allocs) / ops << ",\"ops_per_sec\":" << (ns > 0 ? ops * 1e9 / ns : 0.0)
+        << extra << "}\n";
+}
+
+// times body() once; allocations are those made by this thread while it runs
+template<typename F>
+void benchReport(const char* name, uint64_t ops, F&& body) {
+    uint64_t allocs0 = threadAllocations();
+    auto t0 = chrono::steady_clock::now();
+    body();
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count();
+    benchRecord(name, ops, ns, threadAllocations() - allocs0);
+}
+
+// old string-concatenating call sites vs structured events (sync, filtered, async)
+void benchLogger() {
+    const uint64_t n = 1000000;
+    NullBuffer nb;
+    ostream sink(&nb);
+    const string actor = "Thorin", target = "Orc1";
+    auto attackEvent = [&](uint64_t i) { return LogEvent(LogEvent::ATTACK, Logger::INFO, actor, "", target, int(i & 63)); };
+
+    Logger sync(Logger::INFO, sink);
+    Logger filtered(Logger::ERROR, sink);
+    benchReport("logger/legacy_concat", n, [&] {
+        for (uint64_t i = 0;i < n;i++) sync.log(actor + " attacks " + target + " for " + to_string(int(i & 63)) + " dmg.");
+        });
+    benchReport("logger/sync_event", n, [&] {
+        for (uint64_t i = 0;i < n;i++) sync.emit(Logger::INFO, [&] { return attackEvent(i); });
+        });
+    benchReport("logger/legacy_concat_filtered", n, [&] {
+        for (uint64_t i = 0;i < n;i++) filtered.log(actor + " attacks " + target + " for " + to_string(int(i & 63)) + " dmg.");
+        });
+    benchReport("logger/lazy_filtered", n, [&] {
+        for (uint64_t i = 0;i < n;i++) filtered.emit(Logger::INFO, [&] { return attackEvent(i); });
+        });
+    AsyncLogger async(Logger::INFO, sink);
+    benchReport("logger/async_event_end_to_end", n, [&] {
+        for (uint64_t i = 0;i < n;i++) {
+            async.emit(Logger::INFO, [&] { return attackEvent(i); });
+            if ((i & 2047) == 2047) async.flush(); // stay below ring capacity so nothing is dropped
+        }
+        async.flush();
+        });
+    // game-thread cost only: time the record calls, drain outside the timed region
+    double producerNs = 0;
+    uint64_t producerAllocs = 0;
+    for (uint64_t done = 0; done < n; done += 2048) {
+        uint64_t allocs0 = threadAllocations();
+        auto t0 = chrono::steady_clock::now();
+        for (uint64_t i = done;i < min(n, done + 2048);i++) async.emit(Logger::INFO, [&] { return attackEvent(i); });
+        producerNs += chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count();
+        producerAllocs += threadAllocations() - allocs0;
+        async.flush();
+    }
+    benchRecord("logger/async_event_producer", n, producerNs, producerAllocs, ",\"dropped\":" + to_string(async.droppedCount()));
+}
+
+// libc rand() vs RandomSource implementations, per roll and in bulk
+void benchRandom() {
+    const size_t n = 4000000;
+    long long sum = 0;
+    srand(7);
+    benchReport("rng/libc_rand", n, [&] { for (size_t i = 0;i < n;i++) sum += rand(); });
+    EngineSource<mt19937> mt(7);
+    RandomSource* viaMt = &mt;
+    benchReport("rng/mt19937_source_roll", n, [&] { for (size_t i = 0;i < n;i++) sum += viaMt->roll(); });
+    CounterRng counter(7);
+    RandomSource* viaCounter = &counter;
+    benchReport("rng/counter_roll", n, [&] { for (size_t i = 0;i < n;i++) sum += viaCounter->roll(); });
+    vector<int> buf(4096);
+    benchReport("rng/counter_fill", n, [&] {
+        for (size_t i = 0;i < n;i += buf.size()) {
+            viaCounter->fill(buf.data(), buf.size());
+            sum += buf[i % buf.size()];
+        }
+        });
+    benchReport("rng/counter_fill_crit_rolls", n, [&] {
+        for (size_t i = 0;i < n;i += buf.size()) {
+            viaCounter->fillBelow(buf.data(), buf.size(), 100);
+            sum += buf[i % buf.size()];
+        }
+        });
+    // per-battle stream setup, paid once per seeded battle
+    benchReport("rng/seeded_scope", n / 10, [&] {
+        for (size_t i = 0;i < n / 10;i++) {
+            SeededRngScope scope(i);
+            sum += rollRand();
+        }
+        });
+    benchKeep(sum);
+}
+
+// object path (virtual calls on scattered Characters) vs SoA columns + SIMD kernels
+void benchCombatSoA() {
+    const size_t members = 1024, rounds = 200;
+    Logger quiet(Logger::OFF);
+    Party a = makeWorkloadParty(quiet, members, "A"), b = makeWorkloadParty(quiet, members, "B");
+    vector<uint32_t> order(members), targets(members);
+    for (size_t i = 0;i < members;i++) { order[i] = uint32_t(i); targets[i] = uint32_t((i * 7919) % members); }
+    CounterRng rng(1234);
+    threadRng() = &rng;
+    long long sink = 0;
+    benchReport("combat/object_attack", members * rounds, [&] {
+        for (size_t r = 0;r < rounds;r++)
+            for (size_t i = 0;i < members;i++) sink += a.getMember(i)->attack(*b.getMember(targets[i]));
+        });
+    CombatColumns ca = CombatColumns::fromParty(a), cb = CombatColumns::fromParty(b);
+    SoACombatEngine engine;
+    vector<int> rolls;
+    benchReport("combat/soa_attack", members * rounds, [&] {
+        for (size_t r = 0;r < rounds;r++) {
+            SoACombatEngine::drawRolls(rolls, ca, order);
+            for (int d : engine.attackVolley(ca, cb, order, targets, rolls)) sink += d;
+        }
+        });
+    vector<int> lvl(members), def(members), dmg(members);
+    for (size_t i = 0;i < members;i++) { lvl[i] = ca.level[i]; def[i] = cb.defense[targets[i]]; }
+    benchReport("combat/soa_attack_kernel_only", members * rounds, [&] {
+        for (size_t r = 0;r < rounds;r++) {
+            DamageKernels::attack(ca.attackPower.data(), lvl.data(), def.data(), rolls.data(), dmg.data(), members);
+            sink += dmg[r % members];
+        }
+        });
+    threadRng() = nullptr;
+    benchKeep(sink);
+}
+
+// name index vs the old full-tree dfs scan, for lookups and for insertUnder-driven builds
+void benchSkillTreeIndex() {
+    const size_t n = 200000, legacyN = 5000;
+    vector<unique_ptr<Skill>> pool;
+    for (size_t i = 0;i < n;i++) pool.push_back(make_unique<ActiveSkill>("S" + to_string(i)));
+    auto parentOf = [&](size_t i) { return pool[(i - 1) / 4]->getName(); };
+    auto scan = [](SkillTreeNode* root, string_view name) {
+        SkillTreeNode* result = nullptr;
+        root->dfs([&](SkillTreeNode* node) { if (node->getSkill()->getName() == name) result = node; });
+        return result;
+    };
+
+    SkillTree<Skill*> tree(pool[0].get());
+    benchReport("skilltree/insert_indexed", n - 1, [&] {
+        for (size_t i = 1;i < n;i++) tree.insertUnder(parentOf(i), pool[i].get());
+        });
+    SkillTreeNode legacyRoot(pool[0].get());
+    benchReport("skilltree/insert_dfs_scan(5k)", legacyN - 1, [&] {
+        for (size_t i = 1;i < legacyN;i++) scan(&legacyRoot, parentOf(i))->addChild(pool[i].get());
+        });
+    size_t hits = 0;
+    const size_t lookups = 1000000;
+    benchReport("skilltree/find_indexed", lookups, [&] {
+        for (size_t i = 0;i < lookups;i++) hits += tree.findNodeBySkillName(pool[(i * 7919) % n]->getName()) != nullptr;
+        });
+    benchReport("skilltree/find_indexed_symbol", lookups, [&] {
+        for (size_t i = 0;i < lookups;i++) hits += tree.findNodeBySymbol(pool[(i * 7919) % n]->getSymbol()) != nullptr;
+        });
+    benchReport("skilltree/find_dfs_scan", 20, [&] {
+        for (size_t i = 0;i < 20;i++) hits += scan(tree.getRoot(), pool[(i * 7919) % n]->getName()) != nullptr;
+        });
+    benchKeep(hits);
+}
+
+// pointer-linked SkillTree vs arena-backed FlatSkillTree: build, preorder walk, teardown
+void benchFlatSkillTree() {
+    const size_t n = 300000;
+    vector<unique_ptr<Skill>> pool; // external skills for the pointer tree
+    for (size_t i = 0;i < n;i++) pool.push_back(make_unique<ActiveSkill>("S" + to_string(i), int(i % 13)));
+    auto parentName = [&](size_t i) { return pool[(i - 1) / 4]->getName(); };
+    long long sum = 0;
+
+    auto linked = make_unique<SkillTree<Skill*>>(pool[0].get());
+    benchReport("flattree/linked_build", n, [&] {
+        for (size_t i = 1;i < n;i++) linked->insertUnder(parentName(i), pool[i].get());
+        });
+    benchReport("flattree/linked_preorder", n, [&] {
+        linked->getRoot()->dfs([&](SkillTreeNode* node) { sum += node->getSkill()->effectivePower(); });
+        });
+    benchReport("flattree/linked_destroy", n, [&] { linked.reset(); });
+
+    auto flat = make_unique<FlatSkillTree>();
+    benchReport("flattree/flat_build_arena_skills", n, [&] {
+        flat->emplaceUnder<ActiveSkill>("", "S0", 0);
+        for (size_t i = 1;i < n;i++) flat->emplaceUnder<ActiveSkill>(parentName(i), "S" + to_string(i), int(i % 13));
+        });
+    benchReport("flattree/flat_preorder", n, [&] {
+        flat->dfs([&](FlatSkillTree::NodeId id) { sum += flat->getSkill(id)->effectivePower(); });
+        });
+    benchReport("flattree/flat_destroy", n, [&] { flat.reset(); });
+    benchKeep(sum);
+}
+
+// virtual Skill calls vs variant dispatch, per call and through combinedPower
+void benchStaticSkills() {
+    const size_t n = 4096, rounds = 500;
+    vector<unique_ptr<Skill>> dyn;
+    vector<StaticSkill> stat;
+    for (size_t i = 0;i < n;i++) {
+        unique_ptr<Skill> s;
+        // hashed kind order so the indirect branch cannot learn a pattern
+        switch ((i * 2654435761u >> 7) % 3) {
+        case 0: s = make_unique<ActiveSkill>("A", int(i % 17)); break;
+        case 1: s = make_unique<PassiveSkill>("P", int(i % 7), 0.01 * double(i % 9)); break;
+        default: s = make_unique<UltimateSkill>("U", int(i % 31)); break;
+        }
+        for (size_t u = 0;u < i % 3;u++) s->upgrade();
+        stat.push_back(*StaticSkill::from(*s));
+        dyn.push_back(move(s));
+    }
+    long long sum = 0;
+    benchReport("skills/virtual_effectivePower", n * rounds, [&] {
+        for (size_t r = 0;r < rounds;r++)
+            for (auto& s : dyn) sum += s->effectivePower();
+        });
+    benchReport("skills/variant_effectivePower", n * rounds, [&] {
+        for (size_t r = 0;r < rounds;r++)
+            for (auto& s : stat) sum += s.effectivePower();
+        });
+    char buf[128];
+    const size_t textRounds = rounds / 20;
+    benchReport("skills/virtual_describe", n * textRounds, [&] {
+        for (size_t r = 0;r < textRounds;r++)
+            for (auto& s : dyn) sum += s->describe(buf, sizeof(buf));
+        });
+    benchReport("skills/variant_describe", n * textRounds, [&] {
+        for (size_t r = 0;r < textRounds;r++)
+            for (auto& s : stat) sum += s.describe(buf, sizeof(buf));
+        });
+    // inlining: one kind only, so the virtual branch is perfectly predicted and only the call remains
+    vector<unique_ptr<Skill>> sameDyn;
+    vector<ActiveSkill> sameStatic;
+    for (size_t i = 0;i < n;i++) {
+        sameStatic.emplace_back("A", int(i % 17));
+        sameDyn.push_back(make_unique<ActiveSkill>(sameStatic.back()));
+    }
+    benchReport("skills/virtual_effectivePower_one_kind", n * rounds, [&] {
+        for (size_t r = 0;r < rounds;r++)
+            for (auto& s : sameDyn) sum += s->effectivePower();
+        });
+    benchReport("skills/inlined_effectivePower_one_kind", n * rounds, [&] {
+        for (size_t r = 0;r < rounds;r++)
+            for (auto& s : sameStatic) sum += s.ActiveSkill::effectivePower();
+        });
+
+    Logger quiet(Logger::OFF);
+    Party party = makeWorkloadParty(quiet, 64, "M");
+    for (size_t i = 0;i < party.size();i++)
+        for (size_t k = 0;k < 8;k++) party.getMember(i)->equipSkill(dyn[(i * 8 + k) % n]->clone());
+    StaticParty sp = StaticParty::fromParty(party);
+    const size_t queries = 20000;
+    benchReport("skills/party_combinedPower_virtual", queries, [&] {
+        // virtual effectivePower per skill, bypassing the power cache so both sides do the same work
+        for (size_t q = 0;q < queries;q++)
+            for (size_t i = 0;i < party.size();i++) sum += party.getMember(i)->computeOverallPower();
+        });
+    benchReport("skills/party_combinedPower_static", queries, [&] {
+        for (size_t q = 0;q < queries;q++) sum += sp.combinedPower();
+        });
+    benchKeep(sum);
+}
+
+// SkillTree::generateRandom, descriptionsDFS and findNodeBySkillName on a seeded random tree
+void benchSkillTreeCore() {
+    seedRandom(2024);
+    SkillTree<Skill*> tree;
+    size_t nodes = 0;
+    auto countNodes = [&] { nodes = 0; tree.getRoot()->dfs([&](SkillTreeNode*) { nodes++; }); };
+    const int reps = 10;
+    uint64_t allocs0 = threadAllocations();
+    double ns = 0;
+    size_t generated = 0;
+    vector<Skill*> owned;
+    for (int r = 0;r < reps;r++) {
+        auto t0 = chrono::steady_clock::now();
+        tree.generateRandom(randomSkillFactory, 12, 4, 0x9E3779B9u * unsigned(r + 1));
+        ns += chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count();
+        countNodes();
+        generated += nodes;
+        tree.getRoot()->dfs([&](SkillTreeNode* node) { owned.push_back(node->getSkill()); });
+    }
+    benchRecord("skilltree/generateRandom_per_node", generated, ns, threadAllocations() - allocs0);
+
+    vector<string_view> names;
+    tree.getRoot()->dfs([&](SkillTreeNode* node) { names.push_back(node->getSkill()->getName()); });
+    size_t sum = 0;
+    benchReport("skilltree/descriptionsDFS_per_node", nodes * reps, [&] {
+        for (int r = 0;r < reps;r++) sum += tree.descriptionsDFS().size();
+        });
+    ScratchArena scratch;
+    sum += tree.descriptionsDFS(scratch).size(); // first round sizes the arena
+    scratch.reset();
+    benchReport("skilltree/descriptionsDFS_arena_per_node", nodes * reps, [&] {
+        for (int r = 0;r < reps;r++) {
+            sum += tree.descriptionsDFS(scratch).size();
+            scratch.reset();
+        }
+        });
+    const size_t lookups = 200000;
+    benchReport("skilltree/findNodeBySkillName", lookups, [&] {
+        for (size_t i = 0;i < lookups;i++) sum += tree.findNodeBySkillName(names[(i * 7919) % names.size()]) != nullptr;
+        });
+    benchKeep(sum);
+    for (Skill* sk : owned) delete sk; // the legacy tree does not own its skills
+}
+
+// subtree/path sums from the Euler-tour index vs a DFS per query, and upgrade + index update
+void benchSkillTreeAggregates() {
+    SkillTree<Skill*> tree;
+    tree.generateRandom(randomSkillFactory, 12, 4, 0x9E3779B9u);
+    vector<SkillTreeNode*> nodes;
+    tree.getRoot()->dfs([&](SkillTreeNode* n) { nodes.push_back(n); });
+    uint64_t allocs0 = threadAllocations();
+    auto t0 = chrono::steady_clock::now();
+    SkillTreeAggregates agg(tree);
+    benchRecord("skilltree_agg/build_per_node", nodes.size(),
+        chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count(), threadAllocations() - allocs0);
+
+    long long sum = 0;
+    const size_t queries = 200000;
+    benchReport("skilltree_agg/subtreePower_fenwick", queries, [&] {
+        for (size_t i = 0;i < queries;i++) sum += agg.subtreePower(nodes[(i * 7919) % nodes.size()]);
+        });
+    const size_t scans = 200;
+    benchReport("skilltree_agg/subtreePower_dfs", scans, [&] {
+        for (size_t i = 0;i < scans;i++)
+            nodes[(i * 7919) % nodes.size()]->dfs([&](SkillTreeNode* n) { sum += n->getSkill()->effectivePower(); });
+        });
+    benchReport("skilltree_agg/pathPower_fenwick", queries, [&] {
+        for (size_t i = 0;i < queries;i++) sum += agg.pathPower(nodes[(i * 7919) % nodes.size()]);
+        });
+    benchReport("skilltree_agg/pathPower_parent_walk", queries, [&] {
+        for (size_t i = 0;i < queries;i++)
+            for (SkillTreeNode* n = nodes[(i * 7919) % nodes.size()];n;n = n->getParent()) sum += n->getSkill()->effectivePower();
+        });
+    const size_t upgrades = 100000;
+    benchReport("skilltree_agg/upgrade_and_update", upgrades, [&] {
+        for (size_t i = 0;i < upgrades;i++) agg.upgrade(nodes[(i * 104729) % nodes.size()]);
+        });
+    benchKeep(size_t(sum));
+    for (SkillTreeNode* n : nodes) delete n->getSkill(); // the legacy tree does not own its skills
+}
+
+// one uncached solve on a few-thousand-node tree, then a whole roster through the memo and the pool
+void benchLoadout() {
+    Logger quiet(Logger::OFF);
+    SkillTree<Skill*> tree;
+    tree.generateRandom(randomSkillFactory, 12, 4, 0x9E3779B9u);
+    LoadoutConfig cfg;
+    cfg.budget = 400;
+    Warrior w("W", quiet);
+    Mage m("M", quiet);
+    const int solves = 20;
+    size_t nodes = 0;
+    int sum = 0;
+    benchReport("loadout/solve_uncached", solves, [&] {
+        for (int r = 0;r < solves;r++) {
+            LoadoutSolver solver(tree, cfg);
+            nodes = solver.size();
+            sum += solver.solve(r % 2 ? static_cast<const Character&>(m) : w).power;
+        }
+        });
+    Party party = makeWorkloadParty(quiet, 256, "L");
+    vector<const Character*> roster;
+    for (size_t i = 0;i < party.size();i++) roster.push_back(party.getMember(i));
+    LoadoutSolver solver(tree, cfg);
+    uint64_t allocs0 = threadAllocations();
+    auto t0 = chrono::steady_clock::now();
+    vector<Loadout> picks = solver.solveAll(roster);
+    benchRecord("loadout/solveAll_memoized", roster.size(), chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count(),
+        threadAllocations() - allocs0, ",\"nodes\":" + to_string(nodes) + ",\"dp_runs\":" + to_string(solver.solveCount()));
+    for (auto& l : picks) sum += l.projectedPower;
+    benchKeep(size_t(sum));
+    tree.getRoot()->dfs([&](SkillTreeNode* n) { delete n->getSkill(); }); // the legacy tree does not own its skills
+}
+
+// fork cost, random rollouts per second, and a full root-parallel MCTS decision
+// (decide: about 1000 iterations per ms per core with 16-turn playouts, 6 v 6)
+void benchBattleState() {
+    Logger quiet(Logger::OFF);
+    Party a = makeWorkloadParty(quiet, 6, "A"), b = makeWorkloadParty(quiet, 6, "B");
+    BattleRules rules = *BattleRules::fromParties(a, b);
+    BattleState root(rules, a, b, 1);
+    const size_t forks = 2000000, rollouts = 100000;
+    long long sink = 0;
+    benchReport("mcts/fork", forks, [&] {
+        for (size_t i = 0;i < forks;i++) { BattleState s = root.fork(); s.reseed(i); sink += s.hp(i % s.size()); }
+        });
+    MctsConfig cfg;
+    benchReport("mcts/rollout_full_battle", rollouts, [&] {
+        for (size_t i = 0;i < rollouts;i++) { BattleState s = root.fork(); s.reseed(i); sink += static_cast<long long>(s.playout(0) * 2); }
+        });
+    benchReport("mcts/rollout_truncated", rollouts, [&] {
+        for (size_t i = 0;i < rollouts;i++) { BattleState s = root.fork(); s.reseed(i); sink += static_cast<long long>(s.playout(0, cfg.rolloutTurns) * 2); }
+        });
+    unsigned hw = max(1u, thread::hardware_concurrency());
+    cfg.trees = max(4u, hw);
+    cfg.iterationsPerTree = 5000;
+    MctsDecision d = MctsPlanner(cfg).decide(root);
+    benchRecord("mcts/decide_rollouts", d.rollouts, d.seconds * 1e9, 0,
+        ",\"threads\":" + to_string(hw) + ",\"rollouts_per_ms_per_core\":" + to_string(d.rollouts / (d.seconds * 1e3) / min(hw, cfg.trees)));
+    benchKeep(sink);
+}
+
+// merchant-sized inventories: IndexedInventory vs Inventory scans and snapshot copies
+void benchIndexedInventory() {
+    const size_t cap = 10000, queries = 20000;
+    vector<Item> items;
+    for (size_t i = 0;i < cap;i++) items.emplace_back("Ware_" + to_string(i), int((i * 7919) % 5000));
+    size_t hits = 0;
+    Inventory<Item> plain(cap);
+    IndexedInventory<Item> indexed(cap);
+    benchReport("indexed_inventory/plain_add", cap, [&] { for (auto& it : items) hits += plain.add(it); });
+    benchReport("indexed_inventory/add_batch", cap, [&] { hits += indexed.addBatch(items.data(), items.size()); });
+    benchReport("indexed_inventory/plain_findByName", queries / 20, [&] {
+        for (size_t q = 0;q < queries / 20;q++) hits += plain.findByName(items[(q * 31) % cap].getName()) != nullptr;
+        });
+    benchReport("indexed_inventory/findByName", queries, [&] {
+        for (size_t q = 0;q < queries;q++) hits += indexed.findByName(items[(q * 31) % cap].getName()) != nullptr;
+        });
+    benchReport("indexed_inventory/findBySymbol", queries, [&] {
+        for (size_t q = 0;q < queries;q++) hits += indexed.findBySymbol(items[(q * 31) % cap].getSymbol()) != nullptr;
+        });
+    // top 10 by value: snapshot + partial_sort vs walking the ordered index
+    benchReport("indexed_inventory/plain_top10_snapshot_sort", queries / 100, [&] {
+        for (size_t q = 0;q < queries / 100;q++) {
+            vector<Item> copy = plain.snapshot();
+            partial_sort(copy.begin(), copy.begin() + 10, copy.end(), [](const Item& x, const Item& y) { return x.getValue() > y.getValue(); });
+            hits += copy[0].getValue();
+        }
+        });
+    benchReport("indexed_inventory/top10", queries, [&] {
+        for (size_t q = 0;q < queries;q++) indexed.topByValue(10, [&](const Item& it) { hits += it.getValue(); });
+        });
+    benchReport("indexed_inventory/value_range_50", queries, [&] {
+        for (size_t q = 0;q < queries;q++) {
+            int lo = int((q * 37) % 5000);
+            for (const Item& it : indexed.byValueRange(lo, lo + 49)) hits += it.getValue();
+        }
+        });
+    benchReport("indexed_inventory/plain_snapshot_copy", queries / 100, [&] {
+        for (size_t q = 0;q < queries / 100;q++) hits += plain.snapshot().size();
+        });
+    benchReport("indexed_inventory/view", queries, [&] { for (size_t q = 0;q < queries;q++) hits += indexed.view().size(); });
+    vector<Symbol> doomed;
+    for (size_t i = 0;i < cap;i += 4) doomed.push_back(items[i].getSymbol());
+    benchReport("indexed_inventory/remove_batch_quarter", doomed.size(), [&] { hits += indexed.removeBatch(doomed.data(), doomed.size()); });
+    benchReport("indexed_inventory/removeIfName", cap / 4, [&] {
+        for (size_t i = 1;i < cap;i += 4) hits += indexed.removeIfSymbol(items[i].getSymbol());
+        });
+    benchKeep(hits);
+}
+
+// interned names vs std::string: per-object name memory, and equality on lookup-heavy paths
+void benchSymbols() {
+    const size_t n = 200000;
+    vector<string> texts;
+    for (size_t i = 0;i < n;i++) texts.push_back("Skill_" + to_string(i) + "_of_the_ancient_order");
+    size_t stringBytes = 0;
+    for (auto& t : texts) stringBytes += sizeof(string) + (t.capacity() > 15 ? t.capacity() + 1 : 0);
+    size_t table0 = SymbolTable::global().memoryBytes();
+    vector<Symbol> symbols;
+    symbols.reserve(n);
+    benchReport("symbols/intern_new", n, [&] { for (auto& t : texts) symbols.push_back(Symbol(t)); });
+    size_t symbolBytes = n * sizeof(Symbol) + (SymbolTable::global().memoryBytes() - table0);
+    benchReport("symbols/intern_existing", n, [&] { for (auto& t : texts) benchKeep(Symbol(t).value()); });
+    // the same lookups from several threads at once: shared shard locks, so they should scale
+    unsigned hw = max(1u, thread::hardware_concurrency());
+    double base = 0;
+    for (unsigned t = 1;;t *= 2) {
+        t = min(t, hw);
+        vector<long long> sums(t);
+        vector<thread> pool;
+        auto t0 = chrono::steady_clock::now();
+        for (unsigned w = 0;w < t;w++)
+            pool.emplace_back([&, w] { for (size_t i = 0;i < n;i++) sums[w] += SymbolTable::global().find(texts[(i + w * 7919) % n]); });
+        for (auto& th : pool) th.join();
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count();
+        for (long long s : sums) benchKeep(s);
+        double perSec = double(n) * t / (ns * 1e-9);
+        if (t == 1) base = perSec;
+        string name = "symbols/find_threads_" + to_string(t);
+        benchRecord(name.c_str(), uint64_t(n) * t, ns, 0,
+            ",\"threads\":" + to_string(t) + ",\"speedup\":" + to_string(base > 0 ? perSec / base : 0.0));
+        if (t == hw) break;
+    }
+    // a second copy of every name (e.g. a cloned party) costs 4 bytes per Symbol, not another string
+    benchRecord("symbols/name_memory", n, 0, 0, ",\"string_bytes\":" + to_string(stringBytes) + ",\"symbol_bytes\":" + to_string(symbolBytes)
+        + ",\"string_bytes_per_copy\":" + to_string(stringBytes) + ",\"symbol_bytes_per_copy\":" + to_string(n * sizeof(Symbol)));
+
+    // linear scans as in Inventory::findByName: string compares vs id compares
+    const size_t cap = 1024, queries = 20000;
+    size_t hits = 0;
+    benchReport("symbols/scan_compare_string", queries, [&] {
+        for (size_t q = 0;q < queries;q++) {
+            const string& want = texts[(q * 7919) % cap];
+            for (size_t i = 0;i < cap;i++) if (texts[i] == want) { hits += i; break; }
+        }
+        });
+    benchReport("symbols/scan_compare_symbol", queries, [&] {
+        for (size_t q = 0;q < queries;q++) {
+            Symbol want = symbols[(q * 7919) % cap];
+            for (size_t i = 0;i < cap;i++) if (symbols[i] == want) { hits += i; break; }
+        }
+        });
+    // hashed lookups as in the skill tree name index
+    unordered_map<string, size_t> byString;
+    unordered_map<Symbol, size_t> bySymbol;
+    for (size_t i = 0;i < n;i++) { byString.emplace(texts[i], i); bySymbol.emplace(symbols[i], i); }
+    const size_t lookups = 1000000;
+    benchReport("symbols/hash_find_string", lookups, [&] {
+        for (size_t i = 0;i < lookups;i++) hits += byString.find(texts[(i * 7919) % n])->second;
+        });
+    benchReport("symbols/hash_find_symbol", lookups, [&] {
+        for (size_t i = 0;i < lookups;i++) hits += bySymbol.find(symbols[(i * 7919) % n])->second;
+        });
+    benchKeep(hits);
+}
+
+// Inventory<Item>: add, findByName, removeIfName (capacity 1024, fixed names)
+void benchInventory() {
+    const size_t cap = 1024, rounds = 50;
+    vector<Item> items;
+    for (size_t i = 0;i < cap;i++) items.emplace_back("Item_" + to_string(i), int(i * 37 % 500));
+    Inventory<Item> inv(cap);
+    size_t hits = 0;
+    benchReport("inventory/add", cap * rounds, [&] {
+        for (size_t r = 0;r < rounds;r++) {
+            inv = Inventory<Item>(cap);
+            for (auto& it : items) hits += inv.add(it);
+        }
+        });
+    benchReport("inventory/findByName", cap * rounds, [&] {
+        for (size_t r = 0;r < rounds;r++)
+            for (size_t i = 0;i < cap;i++) hits += inv.findByName(items[(i * 7919 + r) % cap].getName()) != nullptr;
+        });
+    benchReport("inventory/findBySymbol", cap * rounds, [&] {
+        for (size_t r = 0;r < rounds;r++)
+            for (size_t i = 0;i < cap;i++) hits += inv.findBySymbol(items[(i * 7919 + r) % cap].getSymbol()) != nullptr;
+        });
+    benchReport("inventory/removeIfName", cap, [&] {
+        for (size_t i = 0;i < cap;i++) hits += inv.removeIfName(items[(i * 7919) % cap].getName());
+        });
+    benchKeep(hits);
+}
+
+// Party::combinedPower on a 64-member party with several skills each
+void benchPartyPower() {
+    Logger quiet(Logger::OFF);
+    Party party = makeWorkloadParty(quiet, 64, "P");
+    for (size_t i = 0;i < party.size();i++)
+        for (int k = 0;k < 4;k++) party.getMember(i)->equipSkill(unique_ptr<Skill>(new PassiveSkill("Pa", k, 0.02 * k)));
+    const size_t queries = 50000;
+    long long sum = 0;
+    benchReport("party/combinedPower", queries, [&] {
+        for (size_t q = 0;q < queries;q++) sum += party.combinedPower();
+        });
+    // one member changes between queries: one member recomputed, the rest read from cache
+    benchReport("party/combinedPower_after_levelUp", queries / 10, [&] {
+        for (size_t q = 0;q < queries / 10;q++) {
+            party.getMember(q % party.size())->levelUp();
+            sum += party.combinedPower();
+        }
+        });
+    benchReport("party/combinedPower_full_recompute", queries / 10, [&] {
+        for (size_t q = 0;q < queries / 10;q++)
+            for (size_t i = 0;i < party.size();i++) sum += party.getMember(i)->computeOverallPower();
+        });
+    benchKeep(sum);
+}
+
+// full BattleSimulator::simulate runs (logging off) on pre-cloned 4v4 parties
+void benchSimulate() {
+    const size_t battles = 20000;
+    Logger quiet(Logger::OFF);
+    Party a = makeWorkloadParty(quiet, 4, "A"), b = makeWorkloadParty(quiet, 4, "B");
+    vector<Party> as, bs;
+    for (size_t i = 0;i < battles;i++) { as.push_back(a.clone(quiet)); bs.push_back(b.clone(quiet)); }
+    BattleSimulator sim(quiet);
+    CounterRng rng(99);
+    threadRng() = &rng;
+    long long turns = 0;
+    benchReport("battle/simulate", battles, [&] {
+        for (size_t i = 0;i < battles;i++) turns += sim.simulate(as[i], bs[i]).turns;
+        });
+    threadRng() = nullptr;
+    benchRecord("battle/simulate_turns_total", 1, 0, 0, ",\"turns\":" + to_string(turns));
+}
+
+// cost per action: lock-step loop vs the event-driven timeline (same parties, same seeds)
+void benchTimeline() {
+    const size_t battles = 4000, members = 16;
+    Logger quiet(Logger::OFF);
+    Party a = makeWorkloadParty(quiet, members, "A"), b = makeWorkloadParty(quiet, members, "B");
+    auto perAction = [&](const char* name, auto&& simulate) {
+        vector<Party> as, bs;
+        for (size_t i = 0;i < battles;i++) { as.push_back(a.clone(quiet)); bs.push_back(b.clone(quiet)); }
+        uint64_t actions = 0, allocs0 = threadAllocations();
+        auto t0 = chrono::steady_clock::now();
+        for (size_t i = 0;i < battles;i++) actions += simulate(as[i], bs[i], mixSeed(21, i)).turns;
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count();
+        benchRecord(name, actions, ns, threadAllocations() - allocs0);
+    };
+    BattleSimulator lockstep(quiet);
+    TimelineConfig attacksOnly;
+    attacksOnly.useSkills = false;
+    TimelineBattle timeline(quiet, attacksOnly), timelineSkills(quiet);
+    perAction("battle/lockstep_per_action", [&](Party& x, Party& y, uint64_t seed) { return lockstep.simulate(x, y, seed); });
+    perAction("battle/timeline_per_action", [&](Party& x, Party& y, uint64_t seed) { return timeline.simulate(x, y, seed); });
+    perAction("battle/timeline_skills_per_action", [&](Party& x, Party& y, uint64_t seed) { return timelineSkills.simulate(x, y, seed); });
+}
+
+// tens of thousands of live battles on one thread: auto-play throughput, then player side A
+// with input-to-resolution latency (submit() until the task parks again after acting)
+void benchBattleRunner() {
+    const size_t battles = 20000;
+    Logger quiet(Logger::OFF);
+    Party a = makeWorkloadParty(quiet, 3, "A"), b = makeWorkloadParty(quiet, 3, "B");
+    vector<Party> as, bs;
+    auto stage = [&] {
+        as.clear();
+        bs.clear();
+        for (size_t i = 0;i < battles;i++) { as.push_back(a.clone(quiet)); bs.push_back(b.clone(quiet)); }
+    };
+    stage();
+    {
+        BattleRunner runner(quiet);
+        for (size_t i = 0;i < battles;i++) runner.add(as[i], bs[i], mixSeed(23, i));
+        uint64_t allocs0 = threadAllocations();
+        auto t0 = chrono::steady_clock::now();
+        size_t slices = 0;
+        while (size_t n = runner.poll()) slices += n;
+        benchRecord("runner/auto_per_turn_slice", slices, chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count(),
+            threadAllocations() - allocs0, ",\"battles\":" + to_string(battles) + ",\"task_bytes\":" + to_string(sizeof(BattleTask)));
+    }
+    // burst: every parked battle gets its move before the thread resumes any of them;
+    // single: each move is resolved as soon as it arrives, with all other battles parked
+    for (bool burst : { true, false }) {
+        stage();
+        BattleRunner runner(quiet);
+        for (size_t i = 0;i < battles;i++) runner.add(as[i], bs[i], mixSeed(29, i), BattleTask::PLAYER_A);
+        vector<uint32_t> prompted;
+        vector<chrono::steady_clock::time_point> submittedAt(battles);
+        vector<double> latencies;
+        runner.onSuspend = [&](uint32_t id, const BattleTask& t) {
+            if (submittedAt[id] != chrono::steady_clock::time_point())
+                latencies.push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - submittedAt[id]).count());
+            if (t.state() == BattleTask::AWAITING_INPUT) prompted.push_back(id);
+        };
+        auto firstAlive = [](Party& p) {
+            uint8_t i = 0;
+            while (p.getMember(i)->getHP() <= 0) i++;
+            return i;
+        };
+        runner.turnsPerSlice = BattleTask::maxTurns; // a slice runs until the next prompt
+        latencies.reserve(battles * BattleTask::maxTurns / 2);
+        uint64_t allocs0 = threadAllocations();
+        auto t0 = chrono::steady_clock::now();
+        runner.poll();
+        size_t moves = 0;
+        while (!prompted.empty()) {
+            vector<uint32_t> batch;
+            batch.swap(prompted);
+            for (uint32_t id : batch) {
+                const BattleTask& t = runner.task(id);
+                submittedAt[id] = chrono::steady_clock::now();
+                moves += runner.submit(id, { firstAlive(t.party(0)), firstAlive(t.party(1)) });
+                if (!burst) runner.poll();
+            }
+            runner.poll();
+        }
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count();
+        sort(latencies.begin(), latencies.end());
+        auto pct = [&](double q) { return latencies.empty() ? 0.0 : latencies[size_t(q * double(latencies.size() - 1))]; };
+        benchRecord(burst ? "runner/player_moves_burst" : "runner/player_moves_single", moves, ns, threadAllocations() - allocs0,
+            ",\"latency_p50_ns\":" + to_string(pct(0.5)) + ",\"latency_p99_ns\":" + to_string(pct(0.99)) + ",\"live_at_end\":" + to_string(runner.live()));
     }
+}
 
-    virtual ~Character() = default;
+// cost of one probe on the untimed and the sampled path, and a snapshot merge
+void benchStats() {
+    const uint64_t n = 10000000;
+    uint64_t sink = 0;
+    benchReport("stats/probe_scope", n, [&] {
+        for (uint64_t i = 0;i < n;i++) {
+            LAB_PROBE(INVENTORY_FIND);
+            sink += i;
+        }
+        });
+    benchKeep(sink);
+    const uint64_t snaps = 10000;
+    benchReport("stats/snapshot", snaps, [&] {
+        for (uint64_t i = 0;i < snaps;i++) sink += Stats::snapshot().probes[Stats::INVENTORY_FIND].count;
+        });
+    benchKeep(sink);
+}
 
-    // non-trivial: attack uses attackPower & level & some randomness
-    virtual int attack(Character& target) {
-        int raw = attackPower + level * 2;
-        int variance = rand() % (level + 3);
-        int dmg = max(0, raw + variance - target.getDefense());
-        target.takeDamage(dmg);
-        logger.log(name + " attacks " + target.getName() + " for " + to_string(dmg) + " dmg.");
-        return dmg;
+// full description vector vs streaming through one buffer on a ~350k-node tree, and lazy BFS
+// (iterative deepening, O(depth) memory) vs a queue BFS (O(width) frontier)
+void benchTreeWalks() {
+    vector<unique_ptr<Skill>> skills;
+    for (int i = 0;i < 16;i++) skills.push_back(make_unique<ActiveSkill>("Walk" + to_string(i), 10 + i, 5 + i));
+    SkillTree<Skill*> tree(skills[0].get());
+    vector<SkillTreeNode*> level{ tree.getRoot() }, nextLevel;
+    size_t nodes = 1;
+    for (int d = 1;d < 10;d++) { // complete 4-ary tree, 10 levels
+        nextLevel.clear();
+        for (SkillTreeNode* n : level)
+            for (int c = 0;c < 4;c++) nextLevel.push_back(n->addChild(skills[(nodes++) % skills.size()].get()));
+        level.swap(nextLevel);
     }
+    vector<SkillTreeNode*>().swap(level);
+    vector<SkillTreeNode*>().swap(nextLevel);
 
-    virtual void useSkill(size_t idx, Character& target) {
-        if (idx >= ownedSkills.size()) {
-            logger.log(name + " tried to use invalid skill index.", Logger::WARN);
-            return;
-        }
-        Skill* sk = ownedSkills[idx].get();
-        if (!sk) return;
-        logger.log(name + " uses " + sk->getName() + " on " + target.getName());
-        sk->apply(target); // dynamic dispatch
+    size_t sum = 0, retained = 0;
+    uint64_t allocs0 = threadAllocations();
+    auto t0 = chrono::steady_clock::now();
+    {
+        vector<string> all = tree.descriptionsDFS();
+        retained = all.capacity() * sizeof(string);
+        for (auto& s : all) { sum += s.size(); retained += s.capacity() + 1; }
     }
+    benchRecord("walk/descriptionsDFS_vector", nodes, chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count(),
+        threadAllocations() - allocs0, ",\"retained_bytes\":" + to_string(retained));
+    char buf[128];
+    benchReport("walk/streamDescriptions_buffer", nodes, [&] {
+        tree.streamDescriptions(buf, sizeof(buf), [&](string_view text, SkillTreeNode*) { sum += text.size(); return true; });
+        });
+    benchReport("walk/streamDescriptions_first_match", 1000, [&] {
+        for (int r = 0;r < 1000;r++)
+            sum += tree.streamDescriptions(buf, sizeof(buf), [&](string_view, SkillTreeNode* n) { return n->getSkill() != skills.back().get(); });
+        });
+    benchReport("walk/dfs_lazy", nodes, [&] { for (SkillTreeNode* n : tree.walkDfs()) sum += n->childCount(); });
+    benchReport("walk/bfs_lazy", nodes, [&] { for (SkillTreeNode* n : tree.walkBfs()) sum += n->childCount(); });
+    size_t frontier = 0;
+    benchReport("walk/bfs_queue", nodes, [&] {
+        queue<SkillTreeNode*> q;
+        q.push(tree.getRoot());
+        while (!q.empty()) {
+            frontier = max(frontier, q.size());
+            SkillTreeNode* n = q.front();
+            q.pop();
+            sum += n->childCount();
+            for (size_t i = 0;i < n->childCount();i++) q.push(n->child(i));
+        }
+        });
+    benchRecord("walk/bfs_queue_peak_frontier", 1, 0, 0, ",\"nodes\":" + to_string(frontier));
+    benchKeep(sum);
+}
 
-    virtual void equipSkill(unique_ptr<Skill> s) {
-        if (!s) return;
-        logger.log(name + " equips skill " + s->getName());
-        ownedSkills.push_back(move(s));
+// BatchSimulator battles per second as the worker count grows (1, 2, 4, ... up to the hardware threads)
+void benchBatch() {
+    Logger quiet(Logger::OFF);
+    Party a = makeWorkloadParty(quiet, 4, "A"), b = makeWorkloadParty(quiet, 4, "B");
+    const uint64_t battles = 20000;
+    unsigned hw = max(1u, thread::hardware_concurrency());
+    double base = 0;
+    for (unsigned t = 1;;t *= 2) {
+        t = min(t, hw);
+        auto t0 = chrono::steady_clock::now();
+        BatchStats stats = BatchSimulator(t).run(a, b, battles, 42);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        benchKeep(static_cast<long long>(stats.winsA));
+        double perSec = battles / seconds;
+        if (t == 1) base = perSec;
+        string name = "batch/threads_" + to_string(t);
+        benchRecord(name.c_str(), battles, seconds * 1e9, 0,
+            ",\"threads\":" + to_string(t) + ",\"speedup\":" + to_string(base > 0 ? perSec / base : 0.0));
+        if (t == hw) break;
     }
+}
 
-    virtual void levelUp() {
-        level++;
-        hp += 10;
-        mana += 5;
-        attackPower += 2;
-        defense += 1;
-        logger.log(name + " leveled up to " + to_string(level));
+// round-robin throughput as the pool grows (1, 2, 4, ... up to the hardware threads)
+void benchTournament() {
+    Logger quiet(Logger::OFF);
+    vector<Party> roster = makeWorkloadRoster(quiet, 24);
+    unsigned hw = max(1u, thread::hardware_concurrency());
+    double base = 0;
+    for (unsigned t = 1;;t *= 2) {
+        t = min(t, hw);
+        TournamentConfig cfg;
+        cfg.battlesPerPairing = 20;
+        cfg.threads = t;
+        TournamentReport rep = Tournament(cfg).run(roster);
+        double perSec = rep.battlesPerSecond();
+        if (t == 1) base = perSec;
+        string name = "tournament/threads_" + to_string(t);
+        benchRecord(name.c_str(), rep.battles, rep.seconds * 1e9, 0,
+            ",\"threads\":" + to_string(t) + ",\"speedup\":" + to_string(base > 0 ? perSec / base : 0.0) + ",\"steals\":" + to_string(rep.steals));
+        if (t == hw) break;
     }
+}
 
-    virtual void takeDamage(int d) {
-        hp -= d;
-        if (hp < 0) hp = 0;
+// SkillTree::generateParallel on a ~2*10^6 node tree, scaling with the pool size
+void benchParallelTreeGen() {
+    TreeGenConfig cfg;
+    cfg.maxDepth = 17;
+    cfg.minChildren = 1;
+    cfg.maxChildren = 4;
+    cfg.seed = 2024;
+    unsigned hw = max(1u, thread::hardware_concurrency());
+    {
+        SkillTree<Skill*> warm; // interns the generated names, so every timed run measures generation alone
+        benchKeep(warm.generateParallel(cfg).nodes);
     }
+    double base = 0;
+    for (unsigned t = 1;;t *= 2) {
+        t = min(t, hw);
+        cfg.threads = t;
+        TreeGenResult res;
+        {
+            SkillTree<Skill*> tree;
+            res = tree.generateParallel(cfg);
+        }
+        double perSec = res.nodes / res.seconds;
+        if (t == 1) base = perSec;
+        string name = "treegen/threads_" + to_string(t);
+        benchRecord(name.c_str(), res.nodes, res.seconds * 1e9, 0,
+            ",\"threads\":" + to_string(t) + ",\"speedup\":" + to_string(base > 0 ? perSec / base : 0.0) + ",\"steals\":" + to_string(res.steals));
+        if (t == hw) break;
+    }
+}
 
-    virtual int getHP() const { return hp; }
-    virtual int getMana() const { return mana; }
-    virtual int getDefense() const { return defense; }
-    string getName() const { return name; }
-
-    virtual string status() const {
-        return name + " (lvl " + to_string(level) + ") HP:" + to_string(hp) + " MP:" + to_string(mana);
+// cost of recording battles to the binary log, and of rebuilding them from the mapped file
+void benchReplay() {
+    const size_t battles = 20000;
+    Logger quiet(Logger::OFF);
+    Party a = makeWorkloadParty(quiet, 4, "A"), b = makeWorkloadParty(quiet, 4, "B");
+    string path = (filesystem::temp_directory_path() / "lab_replay_bench.bin").string();
+    {
+        ofstream out(path, ios::binary | ios::trunc);
+        ReplayWriter writer(out);
+        BattleSimulator sim(quiet);
+        sim.setReplay(&writer);
+        benchReport("replay/simulate_and_record", battles, [&] {
+            for (size_t i = 0;i < battles;i++) {
+                Party pa = a.clone(quiet), pb = b.clone(quiet);
+                sim.simulate(pa, pb, mixSeed(11, i));
+            }
+            });
     }
+    ReplayReader reader;
+    size_t good = 0;
+    benchReport("replay/open_and_index", battles, [&] { reader.open(path); });
+    benchReport("replay/rebuild_and_verify", reader.battleCount(), [&] {
+        for (size_t i = 0;i < reader.battleCount();i++) good += reader.rebuild(i).consistent;
+        });
+    benchRecord("replay/file_bytes_per_battle", 1, 0, 0,
+        ",\"bytes\":" + to_string(double(filesystem::file_size(path)) / max<size_t>(1, reader.battleCount())));
+    benchKeep(good);
+    filesystem::remove(path);
+}
 
-    // non-trivial: compute overall power from stats and skills
-    virtual int overallPower() const {
-        int p = attackPower + level * 3;
-        for (auto& s : ownedSkills) p += s->effectivePower() / 2;
+// startup: building content in code vs loading it from a mapped snapshot
+void benchSnapshot() {
+    Logger quiet(Logger::OFF);
+    const size_t roster = 3000;
+    seedRandom(5);
+    string path = (filesystem::temp_directory_path() / "lab_snapshot_bench.bin").string();
+    size_t nodes = 0;
+    auto buildRoster = [&] {
+        Party p = makeWorkloadParty(quiet, roster, "Hero");
+        for (size_t i = 0;i < p.size();i++) {
+            p.getMember(i)->equipSkill(unique_ptr<Skill>(new PassiveSkill("Aura" + to_string(i), 5, 0.04)));
+            p.getMember(i)->getInventory().add(Item("Potion", 25));
+        }
         return p;
+    };
+    {
+        SkillTree<Skill*> tree;
+        tree.generateRandom(randomSkillFactory, 14, 4, 0x9E3779B9u);
+        vector<Skill*> owned;
+        tree.getRoot()->dfs([&](SkillTreeNode* n) { owned.push_back(n->getSkill()); });
+        nodes = owned.size();
+        Party p = buildRoster();
+        ofstream out(path, ios::binary | ios::trunc);
+        SnapshotCodec::save(out, &tree, &p);
+        for (Skill* s : owned) delete s;
     }
+    benchReport("snapshot/programmatic_tree_per_node", nodes, [&] {
+        FlatSkillTree t;
+        t.generateRandom(randomSkillFactoryIn, 14, 4, 0x9E3779B9u);
+        });
+    benchReport("snapshot/programmatic_roster_per_member", roster, [&] { Party p = buildRoster(); });
+    SnapshotView view;
+    benchReport("snapshot/map_and_validate", 1, [&] { view.open(path); });
+    benchReport("snapshot/load_tree_per_node", nodes, [&] {
+        FlatSkillTree t;
+        SnapshotCodec::loadTree(view, t);
+        });
+    benchReport("snapshot/load_linked_tree_per_node", nodes, [&] {
+        SkillTree<Skill*> t;
+        SnapshotCodec::loadTree(view, t);
+        });
+    benchReport("snapshot/load_roster_per_member", roster, [&] { Party p = SnapshotCodec::loadParty(view, quiet); });
+    filesystem::remove(path);
+}
 
-    Inventory<Item>& getInventory() { return inventory; }
-    size_t skillCount() const { return ownedSkills.size(); }
-};
+int runBenchmarks(const string& filter) {
+    seedRandom(1);
+    struct Entry { const char* name; void (*run)(); };
+    const Entry all[] = {
+        { "logger", benchLogger },
+        { "stats", benchStats },
+        { "rng", benchRandom },
+        { "combat_soa", benchCombatSoA },
+        { "skilltree_index", benchSkillTreeIndex },
+        { "flat_skilltree", benchFlatSkillTree },
+        { "static_skills", benchStaticSkills },
+        { "skilltree_core", benchSkillTreeCore },
+        { "skilltree_agg", benchSkillTreeAggregates },
+        { "walk", benchTreeWalks },
+        { "symbols", benchSymbols },
+        { "inventory", benchInventory },
+        { "indexed_inventory", benchIndexedInventory },
+        { "mcts", benchBattleState },
+        { "loadout", benchLoadout },
+        { "party_power", benchPartyPower },
+        { "simulate", benchSimulate },
+        { "timeline", benchTimeline },
+        { "runner", benchBattleRunner },
+        { "batch", benchBatch },
+        { "tournament", benchTournament },
+        { "treegen", benchParallelTreeGen },
+        { "replay", benchReplay },
+        { "snapshot", benchSnapshot },
+    };
+    for (auto& b : all)
+        if (filter.empty() || string(b.name).find(filter) != string::npos) b.run();
+    return 0;
+}
 
-/* Derived classes: Warrior, Mage, Archer */
-class Warrior : public Character {
-    int rage;
-public:
-    Warrior(const string& n, Logger& log) : Character(n, log), rage(0) {
-        attackPower += 5;
-        defense += 3;
+/* --------------------- Self-checks (run with: <exe> --verify) --------------------- */
+// SoA kernels must reproduce the virtual attack() of a Warrior/Mage/Archer mix and ActiveSkill::apply
+bool verifySoACombat() {
+    const size_t n = 37; // odd size exercises the scalar tail of the kernels
+    Logger quiet(Logger::OFF);
+    Party a = makeWorkloadParty(quiet, n, "A"), b = makeWorkloadParty(quiet, n, "B");
+    CombatColumns ca = CombatColumns::fromParty(a), cb = CombatColumns::fromParty(b);
+    vector<uint32_t> order(n), targets(n);
+    vector<int> power(n);
+    for (size_t i = 0;i < n;i++) {
+        order[i] = uint32_t(n - 1 - i);
+        targets[i] = uint32_t((i * 5) % n);
+        power[i] = ActiveSkill("probe", 10 + int(order[i] % 7)).effectivePower();
     }
-    int attack(Character& target) override {
-        rage = min(100, rage + 10);
-        int base = Character::attack(target);
-        // warrior special: bonus when rage enough
-        if (rage >= 50) {
-            int bonus = 5 + level;
-            target.takeDamage(bonus);
-            logger.log(name + " uses RAGE bonus for " + to_string(bonus) + " extra dmg!");
-            rage = 0;
-            return base + bonus;
+    bool ok = true;
+    for (int round = 0; round < 12 && ok; round++) { // enough rounds for every warrior to reach its rage bonus
+        CounterRng objRng(100 + round), soaRng(100 + round);
+        threadRng() = &objRng;
+        bool skills = round % 2 == 1; // alternate basic attacks and active skills
+        vector<int> expected;
+        for (size_t i = 0;i < n;i++) {
+            Character& t = *b.getMember(targets[i]);
+            if (!skills) expected.push_back(a.getMember(order[i])->attack(t));
+            else ActiveSkill("probe", 10 + int(order[i] % 7)).ActiveSkill::apply(t);
+        }
+        threadRng() = &soaRng;
+        vector<int> rolls;
+        SoACombatEngine engine;
+        if (skills) {
+            SoACombatEngine::drawRolls(rolls, n);
+            engine.activeSkillVolley(power, cb, targets, rolls);
+        }
+        else {
+            SoACombatEngine::drawRolls(rolls, ca, order);
+            ok = engine.attackVolley(ca, cb, order, targets, rolls) == expected;
+        }
+        ok = ok && objRng.position() == soaRng.position();
+        for (size_t i = 0;i < n && ok;i++) {
+            ok = cb.hp[i] == b.getMember(i)->getHP();
+            if (auto w = dynamic_cast<const Warrior*>(a.getMember(i))) ok = ok && ca.rage[i] == w->getRage();
         }
-        return base;
-    }
-    void battleShout() {
-        // non-trivial buff to self
-        attackPower += 2;
-        logger.log(name + " shouts and increases attack!");
     }
-};
+    threadRng() = nullptr;
+    return ok;
+}
 
-class Mage : public Character {
-    int spellPower;
-public:
-    Mage(const string& n, Logger& log) : Character(n, log), spellPower(10) {
-        mana += 30;
+// counter streams: bulk fill equals single rolls, seek/split are exact, batches ignore thread count
+bool verifyRandomStreams() {
+    CounterRng a(42), b(42);
+    vector<int> bulk(1000);
+    a.fill(bulk.data(), bulk.size());
+    bool ok = true;
+    for (int v : bulk) ok = ok && v == b.roll() && v >= 0;
+    ok = ok && a.position() == 1000 && a.roll() == b.roll();
+    CounterRng c(42);
+    c.seek(500);
+    ok = ok && c.roll() == bulk[500];
+    CounterRng s0 = a.split(0), s1 = a.split(1), again = a.split(1);
+    int same = 0;
+    for (int i = 0;i < 1000;i++) { int x = s1.roll(); ok = ok && x == again.roll(); same += s0.roll() == x; }
+    ok = ok && same < 5;
+    Logger quiet(Logger::OFF);
+    Party pa = makeWorkloadParty(quiet, 4, "A"), pb = makeWorkloadParty(quiet, 5, "B");
+    BatchStats one = BatchSimulator(1).run(pa, pb, 300, 77), three = BatchSimulator(3).run(pa, pb, 300, 77);
+    return ok && one.winsA == three.winsA && one.draws == three.draws && one.totalTurns == three.totalTurns
+        && one.damageByA.total == three.damageByA.total && one.damageByB.buckets == three.damageByB.buckets;
+}
+
+// BattleState must reproduce the object path roll for roll; forks are independent; random actions
+// are uniform over the legal ones; MCTS decisions ignore the thread count and beat random play
+bool verifyBattleState() {
+    // a character without a class override of attack()
+    class Recruit final : public Character {
+    public:
+        using Character::Character;
+        Recruit(const Recruit& o, Logger& log) : Character(o, log) {}
+        unique_ptr<Character> clone(Logger& log) const override { return unique_ptr<Character>(new Recruit(*this, log)); }
+    };
+    Logger quiet(Logger::OFF);
+    Party a = makeWorkloadParty(quiet, 5, "A"), b = makeWorkloadParty(quiet, 4, "B");
+    a.addMember(make_unique<Recruit>("Recruit", quiet));
+    for (Party* p : { &a, &b })
+        for (size_t i = 0;i < p->size();i++) p->getMember(i)->equipSkill(unique_ptr<Skill>(new UltimateSkill("Nova", 30, 20, 2)));
+    optional<BattleRules> rules = BattleRules::fromParties(a, b);
+    if (!rules || rules->fighters[5].cls != BattleRules::BASE) return false;
+    Party crowded = b.clone(quiet); // more castable skills than the rules can hold
+    for (size_t k = 0;k < BattleRules::maxSkills;k++) crowded.getMember(0)->equipSkill(unique_ptr<Skill>(new ActiveSkill("Extra")));
+    if (BattleRules::fromParties(a, crowded)) return false;
+    bool ok = true;
+    for (uint64_t game = 0;game < 20 && ok;game++) {
+        Party pa = a.clone(quiet), pb = b.clone(quiet);
+        BattleState state(*rules, pa, pb, mixSeed(3, game));
+        CounterRng objRng(mixSeed(3, game)), chooser(game);
+        threadRng() = &objRng;
+        vector<BattleAction> legal(BattleRules::maxActions);
+        while (!state.terminal() && ok) {
+            size_t n = state.legalActions(legal.data());
+            BattleState::Legality fast = state.legality(); // the bit-mask check MCTS uses agrees with legal()
+            for (size_t x = 0;x < state.size() && ok;x++)
+                for (size_t ab = 0;ab <= BattleRules::maxSkills && ok;ab++)
+                    for (size_t y = 0;y < state.size() && ok;y++) {
+                        BattleAction probe{ uint8_t(x), uint8_t(ab), uint8_t(y) };
+                        ok = fast.allows(probe) == state.legal(probe);
+                    }
+            BattleAction act = legal[size_t(chooser.roll()) % n];
+            Character* actor = act.actor < rules->sizeA ? pa.getMember(act.actor) : pb.getMember(act.actor - rules->sizeA);
+            Character* target = act.target < rules->sizeA ? pa.getMember(act.target) : pb.getMember(act.target - rules->sizeA);
+            BattleState before = state.fork();
+            state.apply(act);
+            if (act.ability == 0) actor->attack(*target);
+            else actor->Character::useSkill(act.ability - 1u, *target);
+            for (size_t f = 0;f < state.size() && ok;f++) {
+                const Character* c = f < rules->sizeA ? pa.getMember(f) : pb.getMember(f - rules->sizeA);
+                ok = state.hp(f) == c->getHP();
+            }
+            ok = ok && before.turnNumber() + 1 == state.turnNumber() && before.hp(act.target) >= state.hp(act.target);
+        }
+        threadRng() = nullptr;
     }
-    void useSkill(size_t idx, Character& target) override {
-        // mana check non-trivial
-        if (idx >= skillCount()) { logger.log("Invalid skill idx", Logger::WARN); return; }
-        Skill* sk = ownedSkills[idx].get();
-        if (!sk) return;
-        int cost = max(5, sk->effectivePower() / 3);
-        if (mana < cost) {
-            logger.log(name + " doesn't have enough mana (" + to_string(mana) + ") to cast " + sk->getName(), Logger::WARN);
-            return;
+    // every legal action about equally often (a few turns in, so cooldowns and mana differ by actor)
+    BattleState mid(*rules, a, b, 23);
+    for (int t = 0;t < 6 && !mid.terminal();t++) mid.apply(mid.randomAction());
+    if (!mid.terminal()) {
+        vector<BattleAction> legal(BattleRules::maxActions);
+        size_t n = mid.legalActions(legal.data());
+        unordered_map<uint32_t, uint32_t> seen;
+        const uint32_t draws = 400 * uint32_t(n);
+        for (uint32_t d = 0;d < draws && ok;d++) {
+            BattleState s = mid.fork();
+            s.reseed(d);
+            BattleAction act = s.randomAction();
+            ok = mid.legal(act);
+            seen[act.code()]++;
         }
-        mana -= cost;
-        logger.log(name + " casts " + sk->getName() + " costing " + to_string(cost) + " mana.");
-        sk->apply(target);
+        ok = ok && seen.size() == n;
+        for (auto& e : seen) ok = ok && e.second > 250 && e.second < 550; // expected 400
     }
-    int getSpellPower() const { return spellPower; }
-};
 
-class Archer : public Character {
-    int agility;
-public:
-    Archer(const string& n, Logger& log) : Character(n, log), agility(12) {
-        attackPower += 2;
+    MctsConfig cfg;
+    cfg.trees = 3;
+    cfg.iterationsPerTree = 300;
+    cfg.threads = 1;
+    BattleState root(*rules, a, b, 17);
+    MctsDecision one = MctsPlanner(cfg).decide(root);
+    cfg.threads = 3;
+    MctsDecision three = MctsPlanner(cfg).decide(root);
+    ok = ok && one.action == three.action && one.visits.size() == three.visits.size() && root.legal(one.action);
+
+    // side A searches, side B plays randomly; the same games with A random as the baseline
+    cfg.trees = 2;
+    cfg.iterationsPerTree = 500;
+    cfg.threads = 1;
+    double searched = 0, baseline = 0;
+    for (uint64_t game = 0;game < 12;game++) {
+        BattleState s(*rules, a, b, mixSeed(9, game)), r = s.fork();
+        while (!s.terminal()) {
+            if (s.sideToMove() == 0) { cfg.seed = mixSeed(game, s.turnNumber()); s.apply(MctsPlanner(cfg).decide(s).action); }
+            else s.apply(s.randomAction());
+        }
+        searched += s.evaluate(0);
+        baseline += r.playout(0);
     }
-    int attack(Character& target) override {
-        // chance to critical hit depending on agility
-        int chance = min(50, agility + level);
-        int r = rand() % 100;
-        if (r < chance) {
-            int dmg = Character::attack(target) + 7;
-            logger.log(name + " lands a CRITICAL hit!");
-            return dmg;
+    return ok && searched > baseline;
+}
+
+// IndexedInventory against a plain vector model through random adds, removals and batches
+bool verifyIndexedInventory() {
+    const size_t cap = 600;
+    IndexedInventory<Item> inv(cap);
+    vector<Item> model;
+    CounterRng rng(8);
+    auto name = [](int k) { return "Loot_" + to_string(k); }; // 150 names, so duplicates are common
+    bool ok = true;
+    for (int step = 0;step < 3000 && ok;step++) {
+        int op = rng.roll() % 10;
+        if (op < 5) {
+            vector<Item> batch;
+            for (int i = rng.roll() % 8;i >= 0;i--) batch.emplace_back(name(rng.roll() % 150), rng.roll() % 300);
+            size_t fit = min(batch.size(), cap - model.size());
+            ok = inv.addBatch(batch.data(), batch.size()) == fit;
+            model.insert(model.end(), batch.begin(), batch.begin() + fit);
+        }
+        else if (op < 8) {
+            Symbol n(name(rng.roll() % 150));
+            size_t before = model.size();
+            model.erase(remove_if(model.begin(), model.end(), [&](const Item& it) { return it.getSymbol() == n; }), model.end());
+            ok = inv.removeIfSymbol(n) == (model.size() != before);
         }
         else {
-            return Character::attack(target);
+            vector<Symbol> names;
+            for (int i = 0;i < 5;i++) names.push_back(Symbol(name(rng.roll() % 150)));
+            size_t before = model.size();
+            model.erase(remove_if(model.begin(), model.end(), [&](const Item& it) { return find(names.begin(), names.end(), it.getSymbol()) != names.end(); }), model.end());
+            ok = inv.removeBatch(names.data(), names.size()) == before - model.size();
         }
+        ok = ok && inv.size() == model.size() && inv.view().size() == model.size();
+        if (step % 50 != 0) continue;
+        // lookups, top-K and ranges agree with the model
+        for (int k = 0;k < 150 && ok;k++) {
+            Symbol n(name(k));
+            size_t count = count_if(model.begin(), model.end(), [&](const Item& it) { return it.getSymbol() == n; });
+            const Item* found = inv.findBySymbol(n);
+            ok = inv.countByName(n) == count && (found != nullptr) == (count > 0) && (!found || found->getSymbol() == n);
+        }
+        vector<int> values;
+        for (auto& it : model) values.push_back(it.getValue());
+        sort(values.rbegin(), values.rend());
+        vector<int> top;
+        inv.topByValue(20, [&](const Item& it) { top.push_back(it.getValue()); });
+        ok = ok && top == vector<int>(values.begin(), values.begin() + min<size_t>(20, values.size()));
+        int lo = rng.roll() % 300, hi = lo + rng.roll() % 60;
+        vector<int> inRange, expected;
+        for (const Item& it : inv.byValueRange(lo, hi)) inRange.push_back(it.getValue());
+        for (int v : values) if (v >= lo && v <= hi) expected.push_back(v);
+        sort(expected.begin(), expected.end());
+        ok = ok && inRange == expected;
     }
-    void dodge() {
-        // non-trivial defensive move
-        defense += 2;
-        logger.log(name + " prepares to dodge, defense increased temporarily.");
-    }
-};
+    return ok;
+}
 
-/* Implementations of Skill::apply now that Character is declared */
-void ActiveSkill::apply(Character& target) {
-    // Deal damage to target based on effectivePower
-    int p = effectivePower();
-    int variance = rand() % 5;
-    int dmg = max(1, p + variance - target.getDefense());
-    target.takeDamage(dmg);
-    // Assuming we have logging via dynamic cast to access logger? We'll use cout fallback
-    cout << "ActiveSkill " << name << " applied to " << target.getName() << " for " << dmg << " damage\n";
+// interning: one id per text, stable views, lookups never insert, concurrent interning agrees
+static_assert(!is_convertible_v<string, Symbol> && !is_convertible_v<const char*, Symbol> && !is_convertible_v<string_view, Symbol>,
+    "text must not intern implicitly");
+bool verifySymbols() {
+    Symbol a("verify_symbol"), b(string("verify_symbol"));
+    string_view view = a.view();
+    bool ok = a == b && view == "verify_symbol" && Symbol().view().empty();
+    size_t before = SymbolTable::global().size();
+    ok = ok && !Symbol::lookup("verify_symbol_never_interned").valid() && SymbolTable::global().size() == before;
+    vector<vector<Symbol>> perThread(4);
+    vector<thread> pool;
+    for (size_t t = 0;t < perThread.size();t++)
+        pool.emplace_back([&, t] { for (int i = 0;i < 5000;i++) perThread[t].push_back(Symbol("vs_" + to_string((i * 7 + int(t)) % 5000))); });
+    for (auto& th : pool) th.join();
+    for (size_t t = 1;t < perThread.size() && ok;t++)
+        for (int i = 0;i < 5000 && ok;i++) {
+            int text = (i * 7 + int(t)) % 5000, same = 0;
+            while ((same * 7) % 5000 != text) same++; // index in thread 0 that interned the same text
+            ok = perThread[t][i] == perThread[0][same] && perThread[t][i].view() == "vs_" + to_string(text);
+        }
+    // ids the table never handed out (a lookup miss, or past the end) read as empty names
+    ok = ok && Symbol::lookup("verify_symbol_never_interned").view().empty()
+        && SymbolTable::global().name(SymbolTable::Id(SymbolTable::global().size())).empty();
+    return ok && a.view().data() == view.data() && Symbol::lookup("vs_42").valid();
 }
 
-void PassiveSkill::apply(Character& target) {
-    // Passive skill modifies target's stats slightly (non-trivial)
-    // We'll attempt to dynamic_cast to specific types for different effects (example)
-    // Since Character's fields are protected, we cannot change them directly; instead we print/apply conceptual effect.
-    cout << "PassiveSkill " << name << " applied to " << target.getName() << " (passive buff)\n";
+// the name index must agree with a full traversal through inserts and subtree removals
+bool verifySkillTreeIndex() {
+    vector<unique_ptr<Skill>> pool;
+    for (int i = 0;i < 400;i++) pool.push_back(make_unique<PassiveSkill>("P" + to_string(i)));
+    SkillTree<Skill*> tree;
+    for (size_t i = 0;i < pool.size();i++)
+        tree.insertUnder(i ? pool[(i - 1) / 3]->getName() : "", pool[i].get());
+    auto consistent = [&] {
+        size_t nodes = 0;
+        bool ok = true;
+        tree.getRoot()->dfs([&](SkillTreeNode* node) {
+            nodes++;
+            ok = ok && tree.findNodeBySkillName(node->getSkill()->getName()) == node;
+            });
+        return ok && nodes == tree.indexedCount();
+    };
+    if (!consistent()) return false;
+    // remove a few inner subtrees, then make sure none of their names resolve any more
+    for (int victim : { 1, 7, 25 }) {
+        SkillTreeNode* node = tree.findNodeBySkillName(pool[victim]->getName());
+        if (!node || !node->getParent()->removeChildWithSkillName(pool[victim]->getName())) return false;
+    }
+    for (int gone : { 1, 4, 5, 13, 17, 7, 22, 25, 76 })
+        if (tree.findNodeBySkillName(pool[gone]->getName())) return false;
+    if (!consistent()) return false;
+    tree.generateRandom(randomSkillFactory, 5, 3);
+    vector<unique_ptr<Skill>> generated; // the factory's heap skills; the tree does not own them
+    tree.getRoot()->dfs([&](SkillTreeNode* n) { generated.emplace_back(n->getSkill()); });
+    if (!consistent() || tree.findNodeBySkillName(pool[0]->getName())) return false;
+    // repeated names resolve like the original linear DFS (last match in preorder), in both layouts
+    vector<unique_ptr<Skill>> dup;
+    for (int i = 0;i < 60;i++) dup.push_back(make_unique<PassiveSkill>("Dup" + to_string(i % 4)));
+    SkillTree<Skill*> repeated(dup[0].get());
+    FlatSkillTree flat(dup[0].get());
+    for (size_t i = 1;i < dup.size();i++) {
+        SkillTreeNode* parent = nullptr;
+        size_t target = size_t(mixSeed(5, i) % i), seen = 0; // attach under the target-th node in preorder
+        repeated.getRoot()->dfs([&](SkillTreeNode* n) { if (seen++ == target) parent = n; });
+        parent->addChild(dup[i].get());
+        vector<FlatSkillTree::NodeId> flatOrder;
+        flat.dfs([&](FlatSkillTree::NodeId id) { flatOrder.push_back(id); });
+        flat.addChild(flatOrder[target], dup[i].get());
+    }
+    for (int k = 0;k < 4;k++) {
+        string name = "Dup" + to_string(k);
+        SkillTreeNode* last = nullptr;
+        repeated.getRoot()->dfs([&](SkillTreeNode* n) { if (n->getSkill()->getName() == name) last = n; });
+        FlatSkillTree::NodeId flatLast = FlatSkillTree::npos;
+        flat.dfs([&](FlatSkillTree::NodeId id) { if (flat.getSkill(id)->getName() == name) flatLast = id; });
+        if (repeated.findNodeBySkillName(name) != last || flat.findNodeBySkillName(name) != flatLast) return false;
+    }
+    // a moved-from tree is empty but usable
+    SkillTree<Skill*> moved(move(tree));
+    if (tree.indexedCount() != 0 || tree.findNodeBySkillName(pool[0]->getName()) || !moved.getRoot()) return false;
+    tree.insertUnder("", pool[0].get());
+    return tree.findNodeBySkillName(pool[0]->getName()) == tree.getRoot() && tree.indexedCount() == 1;
 }
 
-void UltimateSkill::apply(Character& target) {
-    int p = effectivePower();
-    int dmg = max(5, p - target.getDefense());
-    target.takeDamage(dmg);
-    cout << "UltimateSkill " << name << " strikes " << target.getName() << " for " << dmg << " massive damage!\n";
+// FlatSkillTree must visit nodes in the same preorder as SkillTree and survive very deep trees
+bool verifyFlatSkillTree() {
+    vector<unique_ptr<Skill>> pool;
+    for (int i = 0;i < 500;i++) pool.push_back(make_unique<UltimateSkill>("U" + to_string(i)));
+    SkillTree<Skill*> linked;
+    FlatSkillTree flat;
+    for (size_t i = 0;i < pool.size();i++) {
+        string_view parent = i ? pool[(i * 7919 + 13) % i]->getName() : ""; // scattered parents force range relocation
+        linked.insertUnder(parent, pool[i].get());
+        flat.insertUnder(parent, pool[i].get());
+    }
+    linked.getRoot()->removeChildWithSkillName(pool[1]->getName());
+    flat.removeChildWithSkillName(flat.getRoot(), pool[1]->getName());
+    if (flat.descriptionsDFS() != linked.descriptionsDFS()) return false;
+    if (flat.findNodeBySkillName(pool[1]->getName()) != FlatSkillTree::npos) return false;
+
+    FlatSkillTree deep; // a recursive dfs would overflow the stack long before this depth
+    deep.emplaceUnder<PassiveSkill>("", "D0");
+    FlatSkillTree::NodeId tip = deep.getRoot();
+    for (int i = 1;i < 1000000;i++) tip = deep.addChild(tip, nullptr);
+    size_t visited = 0;
+    deep.dfs([&](FlatSkillTree::NodeId) { visited++; });
+
+    FlatSkillTree generated;
+    generated.generateRandom(randomSkillFactoryIn, 6, 3);
+    return visited == 1000000 && generated.descriptionsDFS().size() == generated.size();
 }
 
-/* --------------------- Party (collection of characters demonstrating polymorphism use) --------------------- */
-class Party {
-    vector<unique_ptr<Character>> members;
-    Logger& logger;
-public:
-    Party(Logger& log) : logger(log) {}
-    void addMember(unique_ptr<Character> c) {
-        logger.log("Adding member " + c->getName());
-        members.push_back(move(c));
+// Euler-tour aggregates must match a DFS / parent walk after every upgrade, and survive a rebuild
+bool verifySkillTreeAggregates() {
+    SkillTree<Skill*> tree;
+    tree.generateRandom(randomSkillFactory, 7, 3, 4242u);
+    vector<SkillTreeNode*> nodes;
+    tree.getRoot()->dfs([&](SkillTreeNode* n) { nodes.push_back(n); });
+    SkillTreeAggregates agg(tree);
+    auto subtreeByDfs = [](SkillTreeNode* node) {
+        long long s = 0;
+        node->dfs([&](SkillTreeNode* n) { s += n->getSkill()->effectivePower(); });
+        return s;
+    };
+    auto pathByWalk = [](SkillTreeNode* node) {
+        long long s = 0;
+        for (SkillTreeNode* n = node;n;n = n->getParent()) s += n->getSkill()->effectivePower();
+        return s;
+    };
+    bool ok = agg.size() == nodes.size() && agg.totalPower() == subtreeByDfs(tree.getRoot());
+    CounterRng rng(17);
+    for (int step = 0;step < 300 && ok;step++) {
+        SkillTreeNode* node = nodes[rng.roll() % nodes.size()];
+        if (step % 5 == 4) { node->getSkill()->upgrade(); agg.refresh(node); }
+        else agg.upgrade(node);
+        SkillTreeNode* probe = nodes[rng.roll() % nodes.size()];
+        ok = agg.subtreePower(probe) == subtreeByDfs(probe) && agg.pathPower(probe) == pathByWalk(probe)
+            && agg.subtreePower(node) == subtreeByDfs(node) && agg.pathPower(node) == pathByWalk(node);
     }
-    Character* getMember(size_t idx) {
-        if (idx >= members.size()) return nullptr;
-        return members[idx].get();
+    // structural change: drop a child subtree of the root, then rebuild
+    SkillTreeNode* root = tree.getRoot();
+    if (ok && root->childCount()) {
+        SkillTreeNode* gone = root->child(0);
+        vector<Skill*> dropped;
+        gone->dfs([&](SkillTreeNode* n) { dropped.push_back(n->getSkill()); });
+        root->removeChildWithSymbol(gone->getSkill()->getSymbol());
+        for (Skill* sk : dropped) delete sk;
+        agg.rebuild(root);
+        nodes.clear();
+        root->dfs([&](SkillTreeNode* n) { nodes.push_back(n); });
+        ok = agg.size() == nodes.size();
+        for (SkillTreeNode* n : nodes) ok = ok && agg.subtreePower(n) == subtreeByDfs(n) && agg.pathPower(n) == pathByWalk(n);
     }
-    size_t size() const { return members.size(); }
+    root->dfs([&](SkillTreeNode* n) { delete n->getSkill(); });
+    return ok;
+}
 
-    // non-trivial: compute combined power
-    int combinedPower() const {
-        int sum = 0;
-        for (auto& m : members) sum += m->overallPower();
-        return sum;
+// the loadout DP must match exhaustive search on small trees, respect prerequisites and budget,
+// and solveAll must agree with solve while running the DP once per distinct cost vector
+bool verifyLoadout() {
+    Logger quiet(Logger::OFF);
+    Warrior w("W", quiet);
+    Mage m("M", quiet);
+    const Character* kinds[] = { &w, &m };
+    for (unsigned seed = 1;seed <= 12;seed++) {
+        SkillTree<Skill*> tree;
+        tree.generateRandom(randomSkillFactory, 3, 3, seed * 7919u);
+        vector<SkillTreeNode*> nodes;
+        tree.getRoot()->dfs([&](SkillTreeNode* n) { nodes.push_back(n); });
+        bool ok = nodes.size() <= 20;
+        LoadoutConfig cfg;
+        cfg.budget = 20 + int(seed % 4) * 25;
+        LoadoutSolver solver(tree, cfg);
+        for (const Character* c : kinds) {
+            if (!ok) break;
+            int bestPower = 0;
+            for (uint32_t mask = 0;mask < (1u << nodes.size());mask++) {
+                int cost = 0, power = 0;
+                bool valid = true;
+                for (size_t i = 0;i < nodes.size() && valid;i++) {
+                    if (!(mask >> i & 1)) continue;
+                    SkillTreeNode* p = nodes[i]->getParent();
+                    if (p) valid = mask >> size_t(find(nodes.begin(), nodes.end(), p) - nodes.begin()) & 1;
+                    cost += cfg.unlockCost + c->skillCost(*nodes[i]->getSkill());
+                    power += nodes[i]->getSkill()->effectivePower() / 2;
+                }
+                if (valid && cost <= cfg.budget) bestPower = max(bestPower, power);
+            }
+            Loadout l = solver.solve(*c);
+            set<SkillTreeNode*> picked(l.skills.begin(), l.skills.end());
+            int cost = 0;
+            for (SkillTreeNode* n : l.skills) {
+                cost += cfg.unlockCost + c->skillCost(*n->getSkill());
+                ok = ok && (!n->getParent() || picked.count(n->getParent()));
+            }
+            ok = ok && l.power == bestPower && l.cost == cost && cost <= cfg.budget
+                && l.projectedPower == c->computeOverallPower() + l.power;
+        }
+        tree.getRoot()->dfs([&](SkillTreeNode* n) { delete n->getSkill(); });
+        if (!ok) return false;
     }
+    SkillTree<Skill*> tree;
+    tree.generateRandom(randomSkillFactory, 8, 3, 31u);
+    Party party = makeWorkloadParty(quiet, 30, "V");
+    vector<const Character*> roster;
+    for (size_t i = 0;i < party.size();i++) roster.push_back(party.getMember(i));
+    LoadoutConfig cfg;
+    cfg.threads = 4;
+    LoadoutSolver parallel(tree, cfg), serial(tree, cfg);
+    vector<Loadout> all = parallel.solveAll(roster);
+    bool ok = parallel.solveCount() == 2; // Mages price skills differently from everyone else
+    for (size_t i = 0;i < roster.size() && ok;i++) {
+        Loadout one = serial.solve(*roster[i]);
+        ok = one.skills == all[i].skills && one.projectedPower == all[i].projectedPower;
+    }
+    tree.getRoot()->dfs([&](SkillTreeNode* n) { delete n->getSkill(); });
+    return ok;
+}
 
-    void showStatus() const {
-        logger.log("Party status:");
-        for (auto& m : members) cout << "  " << m->status() << "\n";
+// counting allocator guard: once warmed up, battle turn loops and arena-backed tree queries
+// must not touch the heap (logging stays on, into a null sink, so its formatting is covered too)
+bool verifyAllocationFree() {
+    NullBuffer nb;
+    ostream sink(&nb);
+    Logger log(Logger::INFO, sink);
+    Party a = makeWorkloadParty(log, 6, "A"), b = makeWorkloadParty(log, 6, "B");
+    const size_t n = 20;
+    vector<Party> as, bs;
+    for (size_t i = 0;i < 2 * n;i++) { as.push_back(a.clone(log)); bs.push_back(b.clone(log)); }
+    auto heapFree = [](auto&& body) {
+        uint64_t allocs0 = threadAllocations();
+        body();
+        return threadAllocations() == allocs0;
+    };
+    BattleSimulator sim(log);
+    bool ok = heapFree([&] { for (size_t i = 0;i < n;i++) sim.simulate(as[i], bs[i], mixSeed(3, i)); });
+    TimelineBattle timeline(log);
+    Party wa = a.clone(log), wb = b.clone(log);
+    timeline.simulate(wa, wb, 1); // sizes the reused per-battle buffers
+    ok = ok && heapFree([&] { for (size_t i = n;i < 2 * n;i++) timeline.simulate(as[i], bs[i], mixSeed(4, i)); });
+    vector<Party> cs, ds;
+    for (size_t i = 0;i < n;i++) { cs.push_back(a.clone(log)); ds.push_back(b.clone(log)); }
+    BattleRunner runner(log);
+    for (size_t i = 0;i < n;i++) runner.add(cs[i], ds[i], mixSeed(5, i));
+    ok = ok && heapFree([&] { while (runner.poll()) {} });
+
+    SkillTree<Skill*> tree;
+    tree.generateRandom(randomSkillFactory, 8, 3, 0x9E3779B9u);
+    FlatSkillTree flat;
+    flat.generateRandom(randomSkillFactoryIn, 8, 3, 0x9E3779B9u);
+    ScratchArena scratch(1024); // deliberately small: the first round spills and regrows it
+    size_t total = 0;
+    auto query = [&] {
+        total += tree.descriptionsDFS(scratch).size() + flat.descriptionsDFS(scratch).size();
+        total += tree.getRoot()->getChildrenRaw(scratch).size();
+        scratch.reset();
+    };
+    query();
+    ok = ok && heapFree([&] { for (int r = 0;r < 5;r++) query(); }) && scratch.capacityBytes() > 1024;
+    auto pooled = tree.descriptionsDFS(scratch);
+    vector<string> heap = tree.descriptionsDFS();
+    ok = ok && pooled.size() == heap.size() && equal(heap.begin(), heap.end(), pooled.begin(),
+        [](const string& x, const pmr::string& y) { return string_view(x) == string_view(y); });
+    tree.getRoot()->dfs([&](SkillTreeNode* node) { delete node->getSkill(); });
+    return ok && total > 100;
+}
+
+// probes count every call exactly (per thread, merged after the threads exit) and both dumps render them
+bool verifyStats() {
+    Stats::reset();
+    Logger quiet(Logger::OFF);
+    Warrior w("W", quiet);
+    Mage m("M", quiet);
+    w.equipSkill(unique_ptr<Skill>(new ActiveSkill("Cleave", 15)));
+    for (int i = 0;i < 100;i++) w.attack(m);
+    for (int i = 0;i < 10;i++) w.useSkill(0, m);
+    Inventory<Item> inv(4);
+    for (int i = 0;i < 5;i++) inv.add(Item("Gem " + to_string(i), i));
+    for (int i = 0;i < 3;i++) inv.findByName("Gem 1");
+    inv.removeIfName("Gem 0");
+    inv.removeIfName("Gem 3");
+    vector<unique_ptr<Skill>> pool;
+    SkillTree<Skill*> tree;
+    for (int i = 0;i < 5;i++) {
+        pool.push_back(make_unique<PassiveSkill>("S" + to_string(i)));
+        tree.insertUnder(i ? "S0" : "", pool.back().get()); // one lookup per insert after the root
     }
-};
+    for (int i = 0;i < 3;i++) tree.findNodeBySkillName("S2");
+    vector<thread> workers;
+    for (int t = 0;t < 3;t++)
+        workers.emplace_back([] {
+            Logger silent(Logger::OFF);
+            Warrior x("X", silent), y("Y", silent);
+            for (int i = 0;i < 200;i++) x.attack(y);
+            });
+    for (auto& t : workers) t.join();
 
-/* --------------------- BattleSimulator --------------------- */
-class BattleSimulator {
-    Logger& logger;
-public:
-    BattleSimulator(Logger& log) : logger(log) {}
+    Stats::Snapshot snap = Stats::snapshot();
+    auto count = [&](Stats::Probe p) { return snap.probes[p].count; };
+    const uint64_t on = LAB_STATS ? 1 : 0;
+    bool ok = count(Stats::ATTACK) == 700 * on && count(Stats::USE_SKILL) == 10 * on && count(Stats::SKILL_APPLY) == 10 * on
+        && count(Stats::INVENTORY_ADD) == 5 * on && count(Stats::INVENTORY_FIND) == 3 * on && count(Stats::INVENTORY_REMOVE) == 2 * on
+        && count(Stats::TREE_LOOKUP) == 7 * on && count(Stats::SIM_TURN) == 0;
+    // every 16th call per thread is timed: 200 / 16 on each new worker, 6 or 7 of 100 here (the stride
+    // phase of this thread carries over from earlier calls)
+    uint64_t timed = snap.probes[Stats::ATTACK].sampled;
+    ok = ok && timed >= (6 + 3 * 12) * on && timed <= (7 + 3 * 12) * on;
+    uint64_t binned = 0;
+    for (uint64_t h : snap.probes[Stats::ATTACK].histogram) binned += h;
+    ok = ok && binned == snap.probes[Stats::ATTACK].sampled;
+    ok = ok && snap.toJson().find("\"attack\":{\"count\":" + to_string(700 * on) + ",") != string::npos
+        && snap.toText().find("tree_lookup") != string::npos;
+    Stats::reset();
+    return ok && Stats::snapshot().probes[Stats::ATTACK].count == 0;
+}
 
-    // Simulate a simple skirmish between two parties (non-trivial orchestration)
-    void simulate(Party& a, Party& b) {
-        logger.log("Battle starts between two parties!");
-        size_t turn = 0;
-        while (turn < 50) {
-            if (allDead(a)) { logger.log("Party A defeated!"); return; }
-            if (allDead(b)) { logger.log("Party B defeated!"); return; }
+// lazy walks: same orders as dfs() / a queue BFS, pruning and early exit honoured, deep chains safe
+bool verifyTreeWalks() {
+    SkillTree<Skill*> tree;
+    tree.generateRandom(randomSkillFactory, 8, 4, 0x9E3779B9u);
+    vector<SkillTreeNode*> preorder, levelOrder;
+    tree.getRoot()->dfs([&](SkillTreeNode* n) { preorder.push_back(n); });
+    auto oddPower = [](const SkillTreeNode* n) { return n->getSkill()->effectivePower() % 2 != 0; };
+    auto queueBfs = [&](bool pruned) {
+        vector<SkillTreeNode*> out;
+        queue<SkillTreeNode*> q;
+        q.push(tree.getRoot());
+        while (!q.empty()) {
+            SkillTreeNode* n = q.front();
+            q.pop();
+            out.push_back(n);
+            if (pruned && oddPower(n)) continue;
+            for (size_t i = 0;i < n->childCount();i++) q.push(n->child(i));
+        }
+        return out;
+    };
+    vector<SkillTreeNode*> got;
+    for (SkillTreeNode* n : tree.walkDfs()) got.push_back(n);
+    bool ok = preorder.size() > 100 && got == preorder;
+    got.clear();
+    for (SkillTreeNode* n : tree.walkBfs()) got.push_back(n);
+    ok = ok && got == queueBfs(false);
+    got.clear();
+    for (SkillTreeNode* n : tree.walkBfs(oddPower)) got.push_back(n);
+    ok = ok && got == queueBfs(true);
+    // pruned DFS = preorder minus the strict descendants of odd-power nodes; skipChildren() agrees
+    vector<SkillTreeNode*> want, viaSkip;
+    for (SkillTreeNode* n : preorder) {
+        bool hidden = false;
+        for (SkillTreeNode* a = n->getParent();a && !hidden;a = a->getParent()) hidden = oddPower(a);
+        if (!hidden) want.push_back(n);
+    }
+    got.clear();
+    for (SkillTreeNode* n : tree.walkDfs(oddPower)) got.push_back(n);
+    auto manual = tree.walkDfs();
+    while (SkillTreeNode* n = manual.next()) {
+        viaSkip.push_back(n);
+        if (oddPower(n)) manual.skipChildren();
+    }
+    ok = ok && got == want && viaSkip == want;
+    // streamed text matches descriptionsDFS, and stopping early visits nothing more
+    vector<string> texts = tree.descriptionsDFS();
+    char buf[96];
+    size_t i = 0;
+    tree.streamDescriptions(buf, sizeof(buf), [&](string_view text, SkillTreeNode*) {
+        ok = ok && i < texts.size() && text == string_view(texts[i]).substr(0, sizeof(buf) - 1);
+        return ++i < texts.size();
+        });
+    size_t seen = 0;
+    ok = ok && i == texts.size() && tree.streamDescriptions(buf, sizeof(buf), [&](string_view, SkillTreeNode*) { return ++seen < 10; }) == 10;
+    tree.getRoot()->dfs([&](SkillTreeNode* n) { delete n->getSkill(); });
 
-            // choose random alive from A and B
-            Character* ca = randomAlive(a);
-            Character* cb = randomAlive(b);
-            if (!ca || !cb) break;
+    // a 10000-deep chain: the walks keep one frame per level and never recurse
+    PassiveSkill link("Link");
+    SkillTree<Skill*> chain(&link);
+    SkillTreeNode* tail = chain.getRoot();
+    for (int d = 1;d < 10000;d++) tail = tail->addChild(&link);
+    size_t count = 0, deepest = 0;
+    auto walk = chain.walkDfs();
+    while (walk.next()) { count++; deepest = max(deepest, walk.depth()); }
+    ok = ok && count == 10000 && deepest == 9999;
+    uint64_t allocs0 = threadAllocations();
+    count = 0;
+    chain.getRoot()->dfs([&](SkillTreeNode*) { count++; });
+    ok = ok && count == 10000 && threadAllocations() - allocs0 < 16; // path growth only
+    return ok;
+}
 
-            // alternate: even turns A attacks, odd B attacks
-            if (turn % 2 == 0) {
-                ca->attack(*cb);
+// variant dispatch must give the same numbers and text as the virtual hierarchy
+bool verifyStaticSkills() {
+    Logger quiet(Logger::OFF);
+    Party party = makeWorkloadParty(quiet, 30, "V");
+    for (size_t i = 0;i < party.size();i++) {
+        Character* c = party.getMember(i);
+        c->equipSkill(unique_ptr<Skill>(new PassiveSkill("P" + to_string(i), int(i % 5), 0.03 * double(i % 4))));
+        c->equipSkill(unique_ptr<Skill>(new UltimateSkill("U" + to_string(i), 20 + int(i))));
+    }
+    for (size_t i = 0;i < party.size();i++) {
+        const Character* c = party.getMember(i);
+        for (size_t k = 0;k < c->skillCount();k++) {
+            StaticSkill s = *StaticSkill::from(*c->getSkill(k));
+            unique_ptr<Skill> d = c->getSkill(k)->clone();
+            for (size_t u = 0;u <= (i + k) % 4;u++) {
+                if (s.effectivePower() != d->effectivePower() || s.description() != d->description()) return false;
+                s.upgrade();
+                d->upgrade();
             }
-            else {
-                cb->attack(*ca);
+        }
+    }
+    return StaticParty::fromParty(party).combinedPower() == party.combinedPower();
+}
+
+// cached overallPower / combinedPower must equal a full recomputation after every kind of mutation
+bool verifyPowerCache() {
+    Logger quiet(Logger::OFF);
+    Party party = makeWorkloadParty(quiet, 9, "C");
+    auto consistent = [](const Party& p) {
+        int sum = 0;
+        for (size_t i = 0;i < p.size();i++) {
+            const Character* c = p.getMember(i);
+            if (c->overallPower() != c->computeOverallPower()) return false;
+            sum += c->computeOverallPower();
+        }
+        return p.combinedPower() == sum;
+    };
+    bool ok = consistent(party);
+    for (size_t step = 0;step < 300 && ok;step++) {
+        Character* c = party.getMember((step * 7) % party.size());
+        switch (step % 5) {
+        case 0: c->levelUp(); break;
+        case 1: c->equipSkill(unique_ptr<Skill>(new UltimateSkill("U" + to_string(step), int(step % 13)))); break;
+        case 2: c->upgradeSkill(step % c->skillCount()); break;
+        case 3: if (auto w = dynamic_cast<Warrior*>(c)) w->battleShout(); break;
+        default: if (auto a = dynamic_cast<Archer*>(c)) a->dodge(); break;
+        }
+        ok = consistent(party);
+        if (step % 50 == 49) { // clones and moved parties keep their own caches
+            Party copy = party.clone(quiet);
+            Party moved = move(copy);
+            moved.getMember(0)->levelUp();
+            ok = ok && consistent(moved) && consistent(party) && moved.combinedPower() > party.combinedPower();
+            // a moved-from party is empty and can be refilled
+            ok = ok && copy.combinedPower() == 0;
+            copy.addMember(party.getMember(0)->clone(quiet));
+            ok = ok && consistent(copy);
+        }
+    }
+    // a skill upgraded through a pointer kept from before equipSkill still refreshes the caches;
+    // its copy in a cloned party is not tied to the original character
+    auto kept = make_unique<ActiveSkill>("Kept", 14);
+    Skill* raw = kept.get();
+    party.getMember(1)->equipSkill(move(kept));
+    Party twin = party.clone(quiet);
+    int twinPower = twin.combinedPower();
+    ok = ok && consistent(party);
+    raw->upgrade();
+    ok = ok && consistent(party) && consistent(twin) && twin.combinedPower() == twinPower && party.combinedPower() > twinPower;
+    // concurrent const readers share one party (as tournament and matchmaking workers do)
+    party.getMember(0)->levelUp();
+    int expected = 0;
+    for (size_t i = 0;i < party.size();i++) expected += party.getMember(i)->computeOverallPower();
+    atomic<int> mismatches{ 0 };
+    const Party& shared = party;
+    vector<thread> readers;
+    for (int t = 0;t < 4;t++)
+        readers.emplace_back([&] { for (int r = 0;r < 100;r++) if (shared.combinedPower() != expected) mismatches++; });
+    for (auto& th : readers) th.join();
+    return ok && mismatches == 0;
+}
+
+// interleaved tasks must end exactly like one blocking simulate() each, and player moves must be
+// validated and applied where the battle was parked
+bool verifyBattleRunner() {
+    Logger quiet(Logger::OFF);
+    Party a = makeWorkloadParty(quiet, 4, "A"), b = makeWorkloadParty(quiet, 3, "B");
+    const size_t n = 40;
+    vector<Party> as, bs, ref;
+    for (size_t i = 0;i < n;i++) { as.push_back(a.clone(quiet)); bs.push_back(b.clone(quiet)); }
+    BattleRunner runner(quiet);
+    for (size_t i = 0;i < n;i++) runner.add(as[i], bs[i], mixSeed(5, i));
+    while (runner.poll(7)) {}
+    BattleSimulator sim(quiet);
+    bool ok = runner.live() == 0;
+    for (size_t i = 0;i < n && ok;i++) {
+        Party x = a.clone(quiet), y = b.clone(quiet);
+        BattleResult want = sim.simulate(x, y, mixSeed(5, i));
+        const BattleResult& got = runner.task(uint32_t(i)).result();
+        ok = got.outcome == want.outcome && got.turns == want.turns && got.damageByA == want.damageByA && got.damageByB == want.damageByB;
+        for (size_t m = 0;m < x.size() && ok;m++) ok = as[i].getMember(m)->getHP() == x.getMember(m)->getHP();
+    }
+    // side B is a player: it must park on every odd turn and take only legal moves
+    Party pa = a.clone(quiet), pb = b.clone(quiet);
+    BattleRunner interactive(quiet);
+    interactive.turnsPerSlice = BattleTask::maxTurns;
+    uint32_t id = interactive.add(pa, pb, 77, BattleTask::PLAYER_B);
+    size_t prompts = 0, moves = 0;
+    interactive.onSuspend = [&](uint32_t, const BattleTask& t) { prompts += t.state() == BattleTask::AWAITING_INPUT; };
+    while (ok && interactive.live()) {
+        interactive.poll();
+        const BattleTask& t = interactive.task(id);
+        if (t.state() != BattleTask::AWAITING_INPUT) break;
+        ok = t.sideToAct() == 1 && !interactive.submit(id, { 200, 0 });
+        uint8_t actor = 0, target = 0;
+        while (pb.getMember(actor)->getHP() <= 0) actor++;
+        while (pa.getMember(target)->getHP() <= 0) target++;
+        int before = pa.getMember(target)->getHP();
+        ok = ok && interactive.submit(id, { actor, target }) && !interactive.submit(id, { actor, target });
+        moves++;
+        interactive.poll(1);
+        ok = ok && pa.getMember(target)->getHP() < before;
+    }
+    const BattleTask& t = interactive.task(id);
+    return ok && t.state() == BattleTask::FINISHED && moves > 0 && prompts == moves;
+}
+
+// seeded battles replay bit-for-bit, and the mmap reader rebuilds every battle from the log
+bool verifyReplayLog() {
+    Logger quiet(Logger::OFF);
+    Party a = makeWorkloadParty(quiet, 5, "A"), b = makeWorkloadParty(quiet, 4, "B");
+    string path = (filesystem::temp_directory_path() / "lab_replay_check.bin").string();
+    const uint64_t battles = 300;
+    vector<BattleResult> expected;
+    vector<vector<int>> finalHp;
+    {
+        ofstream out(path, ios::binary | ios::trunc);
+        ReplayWriter writer(out);
+        BattleSimulator sim(quiet);
+        sim.setReplay(&writer);
+        for (uint64_t i = 0;i < battles;i++) {
+            Party pa = a.clone(quiet), pb = b.clone(quiet);
+            expected.push_back(sim.simulate(pa, pb, mixSeed(5, i)));
+            vector<int> hp;
+            for (size_t m = 0;m < pa.size();m++) hp.push_back(pa.getMember(m)->getHP());
+            for (size_t m = 0;m < pb.size();m++) hp.push_back(pb.getMember(m)->getHP());
+            finalHp.push_back(hp);
+        }
+    }
+    ReplayReader reader;
+    bool ok = reader.open(path) && reader.battleCount() == battles;
+    for (size_t i = 0;i < battles && ok;i++) {
+        ReplaySummary s = reader.rebuild(i);
+        ok = s.consistent && s.finalHp == finalHp[i] && s.result.outcome == expected[i].outcome
+            && reader.battle(i).header.seed == mixSeed(5, i);
+    }
+    // same seed, same battle
+    BattleSimulator again(quiet);
+    Party pa = a.clone(quiet), pb = b.clone(quiet);
+    BattleResult r = again.simulate(pa, pb, mixSeed(5, 17));
+    ok = ok && r.turns == expected[17].turns && r.damageByA == expected[17].damageByA && r.damageByB == expected[17].damageByB;
+    filesystem::remove(path);
+    // battles the format cannot hold are refused up front instead of being logged truncated
+    auto refused = [&](Party& big, Party& other) {
+        ostringstream sink;
+        ReplayWriter writer(sink);
+        BattleSimulator sim(quiet);
+        sim.setReplay(&writer);
+        int hp = big.getMember(0)->getHP();
+        try { sim.simulate(big, other, 1); }
+        catch (const length_error&) { return writer.battlesWritten() == 0 && big.getMember(0)->getHP() == hp; }
+        return false;
+    };
+    Party crowd = makeWorkloadParty(quiet, ReplayEvent::maxPartySize + 1, "X");
+    Party skilled = a.clone(quiet), sturdy = a.clone(quiet), pb2 = b.clone(quiet);
+    for (size_t k = 0;k < ReplayEvent::maxSkills;k++) skilled.getMember(0)->equipSkill(unique_ptr<Skill>(new ActiveSkill("S" + to_string(k))));
+    while (sturdy.getMember(0)->getHP() <= int(ReplayEvent::maxDamage)) sturdy.getMember(0)->levelUp();
+    return ok && ReplayWriter::fits(a) && refused(crowd, pb2) && refused(skilled, pb2) && refused(sturdy, pb2);
+}
+
+// timeline battles: replay stays consistent, seeds reproduce, and cooldowns hold per caster
+bool verifyTimelineBattle() {
+    Logger quiet(Logger::OFF);
+    Party a = makeWorkloadParty(quiet, 6, "A"), b = makeWorkloadParty(quiet, 5, "B");
+    for (Party* p : { &a, &b })
+        for (size_t i = 0;i < p->size();i++) p->getMember(i)->equipSkill(unique_ptr<Skill>(new UltimateSkill("Nova", 30, 20, 3)));
+    string path = (filesystem::temp_directory_path() / "lab_timeline_check.bin").string();
+    const uint64_t battles = 200;
+    vector<BattleResult> expected;
+    vector<vector<int>> finalHp;
+    {
+        ofstream out(path, ios::binary | ios::trunc);
+        ReplayWriter writer(out);
+        TimelineBattle sim(quiet);
+        sim.setReplay(&writer);
+        for (uint64_t i = 0;i < battles;i++) {
+            Party pa = a.clone(quiet), pb = b.clone(quiet);
+            expected.push_back(sim.simulate(pa, pb, mixSeed(11, i)));
+            vector<int> hp;
+            for (size_t m = 0;m < pa.size();m++) hp.push_back(pa.getMember(m)->getHP());
+            for (size_t m = 0;m < pb.size();m++) hp.push_back(pb.getMember(m)->getHP());
+            finalHp.push_back(hp);
+        }
+    }
+    ReplayReader reader;
+    bool ok = reader.open(path) && reader.battleCount() == battles;
+    size_t ultimates = 0;
+    for (size_t i = 0;i < battles && ok;i++) {
+        ReplaySummary s = reader.rebuild(i);
+        ok = s.consistent && s.finalHp == finalHp[i] && s.result.outcome == expected[i].outcome
+            && s.result.damageByA == expected[i].damageByA && s.result.damageByB == expected[i].damageByB;
+        // the ultimate (skill 1, cooldown 3) needs three other actions of its caster in between
+        ReplayReader::BattleView v = reader.battle(i);
+        int ownActions[64] = {}, lastUltimate[64];
+        fill(begin(lastUltimate), end(lastUltimate), -100);
+        for (uint32_t k = 0;k < v.header.eventCount && ok;k++) {
+            uint32_t e = v.events[k];
+            if (ReplayEvent::kind(e) == ReplayEvent::DEATH) continue;
+            uint32_t who = ReplayEvent::actor(e);
+            if (ReplayEvent::kind(e) == ReplayEvent::SKILL && ReplayEvent::skill(e) == 1) {
+                ok = ownActions[who] - lastUltimate[who] >= 4;
+                lastUltimate[who] = ownActions[who];
+                ultimates++;
             }
-            turn++;
+            ownActions[who]++;
         }
-        logger.log("Battle ended after max turns.");
     }
+    ok = ok && ultimates > 0;
+    TimelineBattle again(quiet);
+    Party pa = a.clone(quiet), pb = b.clone(quiet);
+    BattleResult r = again.simulate(pa, pb, mixSeed(11, 42));
+    ok = ok && r.turns == expected[42].turns && r.damageByA == expected[42].damageByA && r.damageByB == expected[42].damageByB;
+    filesystem::remove(path);
+    return ok;
+}
 
-private:
-    bool allDead(Party& p) {
-        for (size_t i = 0;i < p.size();++i) {
-            Character* c = p.getMember(i);
-            if (c && c->getHP() > 0) return false;
+// async events keep long names whole; loggers can come and go on a thread that keeps logging
+bool verifyAsyncLogger() {
+    const string actor(40, 'a'), skill(70, 's'), target = "Orc1";
+    ostringstream direct;
+    LogEvent(LogEvent::USE_SKILL, Logger::INFO, actor, skill, target).write(direct);
+    bool ok = direct.str() == actor + " uses " + skill + " on " + target;
+    string text(300, 't');
+    ostringstream longText;
+    LogEvent::text(Logger::INFO, text.c_str()).write(longText);
+    ok = ok && longText.str() == text;
+    for (int round = 0;round < 3 && ok;round++) {
+        mutex m;
+        vector<string> seen;
+        {
+            AsyncLogger async(Logger::INFO, [&](const LogEvent& e) {
+                ostringstream os;
+                e.write(os);
+                lock_guard<mutex> g(m);
+                seen.push_back(os.str());
+                });
+            thread other([&] { for (int i = 0;i < 100;i++) async.record(LogEvent(LogEvent::ATTACK, Logger::INFO, actor, "", target, i)); });
+            for (int i = 0;i < 100;i++) async.record(LogEvent(LogEvent::ATTACK, Logger::INFO, actor, "", target, i));
+            other.join();
+            async.flush();
+            ok = ok && async.droppedCount() == 0;
         }
-        return true;
+        ok = ok && seen.size() == 200 && seen.back().compare(0, actor.size(), actor) == 0;
     }
-    Character* randomAlive(Party& p) {
-        vector<Character*> alive;
-        for (size_t i = 0;i < p.size();++i) {
-            Character* c = p.getMember(i);
-            if (c && c->getHP() > 0) alive.push_back(c);
+    return ok;
+}
+
+// tournament tables must not depend on the number of pool threads
+bool verifyTournament() {
+    Logger quiet(Logger::OFF);
+    vector<Party> roster = makeWorkloadRoster(quiet, 7);
+    TournamentConfig cfg;
+    cfg.battlesPerPairing = 6;
+    cfg.seed = 31;
+    cfg.threads = 1;
+    TournamentReport one = Tournament(cfg).run(roster);
+    cfg.threads = 3;
+    TournamentReport three = Tournament(cfg).run(roster);
+    bool ok = one.pairings.size() == 21 && one.battles == 21 * 6 && one.winMatrix == three.winMatrix && one.elo == three.elo;
+    double ratingSum = 0;
+    for (double e : one.elo) ratingSum += e;
+    ok = ok && fabs(ratingSum - 1500.0 * roster.size()) < 1e-6; // Elo updates are zero-sum
+    for (size_t i = 0;i < one.pairings.size() && ok;i++) {
+        const PairingResult& p = one.pairings[i], & q = three.pairings[i];
+        ok = p.winsFirst == q.winsFirst && p.winsSecond == q.winsSecond && p.draws == q.draws && p.turns == q.turns
+            && one.wins(p.first, p.second) == p.winsFirst && one.wins(p.second, p.first) == p.winsSecond;
+    }
+    // a throwing task reaches the caller of run() (on any worker) instead of terminating the process
+    for (uint32_t bad : { 0u, 37u, 99u }) {
+        atomic<uint32_t> ran{ 0 };
+        try {
+            WorkStealingPool(3).run(100, [&](uint32_t t, unsigned) {
+                if (t == bad) throw runtime_error("task " + to_string(t));
+                ran++;
+                });
+            ok = false;
         }
-        if (alive.empty()) return nullptr;
-        return alive[rand() % alive.size()];
+        catch (const runtime_error& e) { ok = ok && e.what() == "task " + to_string(bad) && ran < 100; }
     }
-};
+    return ok;
+}
 
-/* --------------------- Helper skill factory for random generation --------------------- */
-Skill* randomSkillFactory() {
-    static int counter = 0;
-    counter++;
-    int t = rand() % 3;
-    if (t == 0) return new ActiveSkill("Active_" + to_string(counter), 10 + (counter % 5));
-    if (t == 1) return new PassiveSkill("Passive_" + to_string(counter), 5 + (counter % 3));
-    return new UltimateSkill("Ult_" + to_string(counter), 25 + (counter % 8));
+// generateParallel: same tree for a seed at any thread count, fully indexed, parents wired, and
+// the tree keeps its skills alive across regeneration without interning new names
+bool verifyParallelTreeGen() {
+    TreeGenConfig cfg;
+    cfg.maxDepth = 7;
+    cfg.minChildren = 1;
+    cfg.maxChildren = 4;
+    cfg.seed = 99;
+    cfg.splitNodes = 16;
+    auto shapeOf = [](SkillTree<Skill*>& tree) {
+        string s;
+        tree.getRoot()->dfs([&](SkillTreeNode* n) { s += string(n->getSkill()->getName()) + "/" + to_string(n->childCount()) + ";"; });
+        return s;
+    };
+    bool ok = true;
+    string first;
+    for (unsigned threads : { 1u, 2u, 4u }) {
+        cfg.threads = threads;
+        SkillTree<Skill*> tree;
+        tree.generateParallel(cfg);
+        size_t interned = SymbolTable::global().size();
+        size_t nodes = tree.generateParallel(cfg).nodes; // replaces the first tree, result dropped
+        ok = ok && SymbolTable::global().size() == interned;
+        string shape = shapeOf(tree);
+        if (first.empty()) first = shape;
+        ok = ok && shape == first && nodes == tree.indexedCount() && nodes > 100;
+        size_t visited = 0;
+        tree.getRoot()->dfs([&](SkillTreeNode* n) {
+            visited++;
+            for (size_t i = 0;i < n->childCount();i++) ok = ok && n->child(i)->getParent() == n;
+            ok = ok && n->getSkill()->getName().substr(0, 4) == "Gen_"
+                && tree.findNodeBySkillName(n->getSkill()->getName()) == n; // ids make names unique
+            });
+        ok = ok && visited == nodes;
+    }
+    cfg.seed = 100;
+    SkillTree<Skill*> other;
+    other.generateParallel(cfg);
+    return ok && shapeOf(other) != first;
+}
+
+// snapshot round trip: same tree preorder and same characters (stats, skills, inventories)
+bool verifySnapshot() {
+    Logger quiet(Logger::OFF);
+    seedRandom(3);
+    SkillTree<Skill*> tree;
+    tree.generateRandom(randomSkillFactory, 6, 3, 0x9E3779B9u);
+    vector<Skill*> treeSkills;
+    tree.getRoot()->dfs([&](SkillTreeNode* n) { treeSkills.push_back(n->getSkill()); n->getSkill()->upgrade(); });
+    Party party = makeWorkloadParty(quiet, 12, "S");
+    party.addMember(make_unique<Commoner>("Plain", quiet));
+    for (size_t i = 0;i < party.size();i++) {
+        Character* c = party.getMember(i);
+        c->equipSkill(unique_ptr<Skill>(new UltimateSkill("U" + to_string(i), 30 + int(i), 25, 2 + int(i % 3))));
+        c->equipSkill(unique_ptr<Skill>(new PassiveSkill("P" + to_string(i), 4, 0.07)));
+        c->getInventory().add(Item("Gem " + to_string(i), int(i) * 10));
+        c->takeDamage(int(i));
+    }
+    string path = (filesystem::temp_directory_path() / "lab_snapshot_check.bin").string();
+    {
+        ofstream out(path, ios::binary | ios::trunc);
+        SnapshotCodec::save(out, &tree, &party);
+    }
+    SnapshotView view;
+    bool ok = view.open(path);
+    FlatSkillTree loaded;
+    if (ok) SnapshotCodec::loadTree(view, loaded);
+    ok = ok && loaded.descriptionsDFS() == tree.descriptionsDFS();
+    // the linked tree restores too, indexed, and a second load replaces the first
+    SkillTree<Skill*> linked;
+    for (int round = 0;round < 2 && ok;round++) {
+        SnapshotCodec::loadTree(view, linked);
+        SkillTreeNode* deep = linked.findNodeBySkillName(treeSkills.back()->getName());
+        ok = linked.descriptionsDFS() == tree.descriptionsDFS() && linked.indexedCount() == tree.indexedCount()
+            && deep && deep->getSkill()->description() == treeSkills.back()->description();
+    }
+    if (ok) {
+        Party back = SnapshotCodec::loadParty(view, quiet);
+        ok = back.size() == party.size() && back.combinedPower() == party.combinedPower();
+        for (size_t i = 0;i < party.size() && ok;i++) {
+            Character* x = party.getMember(i);
+            Character* y = back.getMember(i);
+            ok = x->status() == y->status() && x->getDefense() == y->getDefense() && x->overallPower() == y->overallPower()
+                && x->getInventory().toString() == y->getInventory().toString() && typeid(*x) == typeid(*y);
+            for (size_t k = 0;k < x->skillCount() && ok;k++) ok = x->getSkill(k)->description() == y->getSkill(k)->description();
+        }
+    }
+    // long names survive, and corrupt records are refused by open() instead of reaching the loaders
+    string longName(70000, 'n');
+    party.getMember(0)->equipSkill(unique_ptr<Skill>(new ActiveSkill(longName)));
+    {
+        ofstream out(path, ios::binary | ios::trunc);
+        SnapshotCodec::save(out, &tree, &party);
+    }
+    ok = ok && view.open(path) && SnapshotCodec::loadParty(view, quiet).getMember(0)->getSkill(3)->getName() == longName;
+    string bytes;
+    {
+        ifstream in(path, ios::binary);
+        bytes.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    SnapshotHeader hdr;
+    memcpy(&hdr, bytes.data(), sizeof(hdr));
+    auto refuses = [&](uint64_t offset, auto value) {
+        string bad = bytes;
+        memcpy(&bad[offset], &value, sizeof(value));
+        ofstream(path, ios::binary | ios::trunc).write(bad.data(), streamsize(bad.size()));
+        return !view.open(path);
+    };
+    const uint64_t node1 = hdr.nodesOffset + sizeof(SnapshotNode), member0 = hdr.membersOffset;
+    ok = ok && hdr.nodeCount > 1
+        && refuses(node1 + offsetof(SnapshotNode, parent), 1)                       // parent not before the child
+        && refuses(node1 + offsetof(SnapshotNode, skill), hdr.skillCount)           // skill index out of range
+        && refuses(hdr.skillsOffset + offsetof(SnapshotSkill, nameLength), UINT32_MAX) // name past the string table
+        && refuses(hdr.skillsOffset + offsetof(SnapshotSkill, kind), 9)            // unknown kind
+        && refuses(member0 + offsetof(SnapshotMember, firstSkill), hdr.skillCount)  // skill range past the array
+        && refuses(member0 + offsetof(SnapshotMember, itemCount), hdr.itemCount + 1)
+        && refuses(offsetof(SnapshotHeader, stringBytes), uint64_t(0) - hdr.stringsOffset); // offset + size wraps to 0
+    // types the format cannot encode are refused at save time instead of being written as their base
+    class Squire final : public Warrior { using Warrior::Warrior; };
+    class EchoSkill final : public ActiveSkill { using ActiveSkill::ActiveSkill; };
+    auto saveRefused = [](const SkillTree<Skill*>* t, const Party* p) {
+        ostringstream out;
+        try { SnapshotCodec::save(out, t, p); }
+        catch (const invalid_argument&) { return true; }
+        return false;
+    };
+    Party odd(quiet);
+    odd.addMember(make_unique<Squire>("Squire", quiet));
+    EchoSkill echo("Echo");
+    SkillTree<Skill*> oddTree(&echo);
+    ok = ok && saveRefused(nullptr, &odd) && saveRefused(&oddTree, nullptr);
+    for (Skill* s : treeSkills) delete s;
+    filesystem::remove(path);
+    return ok;
+}
+
+int runSelfChecks() {
+    struct Entry { const char* name; bool (*run)(); };
+    const Entry all[] = {
+        { "random_streams_reproducible", verifyRandomStreams },
+        { "async_logger_full_names", verifyAsyncLogger },
+        { "symbols_interned_once", verifySymbols },
+        { "indexed_inventory_matches_model", verifyIndexedInventory },
+        { "battle_state_mcts", verifyBattleState },
+        { "loadout_matches_exhaustive", verifyLoadout },
+        { "soa_combat_matches_object_path", verifySoACombat },
+        { "skilltree_index_consistent", verifySkillTreeIndex },
+        { "flat_skilltree_matches_linked", verifyFlatSkillTree },
+        { "skilltree_aggregates_match_dfs", verifySkillTreeAggregates },
+        { "skilltree_walks_lazy", verifyTreeWalks },
+        { "static_skills_match_virtual", verifyStaticSkills },
+        { "power_cache_matches_recompute", verifyPowerCache },
+        { "replay_log_roundtrip", verifyReplayLog },
+        { "timeline_battle_consistent", verifyTimelineBattle },
+        { "battle_runner_matches_simulator", verifyBattleRunner },
+        { "tournament_thread_independent", verifyTournament },
+        { "parallel_treegen_thread_independent", verifyParallelTreeGen },
+        { "snapshot_roundtrip", verifySnapshot },
+        { "hot_paths_allocation_free", verifyAllocationFree },
+        { "stats_probes_count_calls", verifyStats },
+    };
+    int failures = 0;
+    for (auto& c : all) {
+        bool ok = c.run();
+        cout << c.name << ": " << (ok ? "ok" : "FAILED") << "\n";
+        failures += ok ? 0 : 1;
+    }
+    return failures ? 1 : 0;
 }
 
 /* --------------------- Main demonstration --------------------- */
-int main() {
+int main(int argc, char** argv) {
     ios::sync_with_stdio(false);
     cin.tie(nullptr);
-    srand((unsigned)time(nullptr));
+    // --stats (text) or --stats-json anywhere on the command line: dump the hot-path counters on exit
+    vector<string> args;
+    bool statsText = false, statsJson = false;
+    for (int i = 1;i < argc;i++) {
+        string arg = argv[i];
+        if (arg == "--stats") statsText = true;
+        else if (arg == "--stats-json") statsJson = true;
+        else args.push_back(arg);
+    }
+    auto finish = [&](int rc) {
+        if (statsText || statsJson) {
+            Stats::Snapshot snap = Stats::snapshot();
+            cout << (statsJson ? snap.toJson() + "\n" : snap.toText());
+        }
+        return rc;
+    };
+    if (!args.empty() && args[0] == "--bench") return finish(runBenchmarks(args.size() > 1 ? args[1] : ""));
+    if (!args.empty() && args[0] == "--verify") return finish(runSelfChecks());
+    // every random choice below derives from one seed; pass --seed N to reproduce a run
+    uint64_t seed = (args.size() > 1 && args[0] == "--seed") ? stoull(args[1]) : uint64_t(time(nullptr));
+    cout << "Seed: " << seed << "\n";
+    seedRandom(seed);
     Logger logger(Logger::INFO);
 
     // Create skill tree (template)
     SkillTree<Skill*> tree;
-    tree.generateRandom(randomSkillFactory, 3, 2);
+    tree.generateRandom(randomSkillFactory, 3, 2, unsigned(mixSeed(seed, 0)));
     cout << "Generated Skill Tree (DFS descriptions):\n";
     for (auto& s : tree.descriptionsDFS()) cout << " - " << s << "\n";
 
@@ -578,14 +6666,27 @@ int main() {
     cout << "Party A combined power: " << partyA.combinedPower() << "\n";
     cout << "Party B combined power: " << partyB.combinedPower() << "\n";
 
+    // Keep pristine copies as templates for the Monte Carlo sweep below
+    Party templA = partyA.clone(logger);
+    Party templB = partyB.clone(logger);
+
     // Simulate battle
     BattleSimulator sim(logger);
-    sim.simulate(partyA, partyB);
+    sim.simulate(partyA, partyB, mixSeed(seed, 1));
+
+    // Monte Carlo balance sweep (many independent battles across all cores)
+    BatchSimulator batch;
+    BatchStats st = batch.run(templA, templB, 10000, mixSeed(seed, 2));
+    cout << "Batch of " << st.battles << " battles on " << batch.threadCount() << " threads: "
+        << "A wins " << st.winRateA() * 100 << "%, B wins " << st.winRateB() * 100 << "%, draws " << st.drawRate() * 100
+        << "%, mean turns " << st.meanTurns() << "\n";
+    cout << "  damage by A: " << st.damageByA.toString() << "\n";
+    cout << "  damage by B: " << st.damageByB.toString() << "\n";
 
     // Demonstrate finding a skill in the skill tree
     auto root = tree.getRoot();
     if (root && root->getSkill()) {
-        string q = root->getSkill()->getName();
+        string_view q = root->getSkill()->getName();
         auto found = tree.findNodeBySkillName(q);
         if (found) cout << "Found root skill by name: " << q << "\n";
     }
@@ -595,5 +6696,5 @@ int main() {
 
     // End
     cout << "\n--- Demo finished ---\n";
-    return 0;
+    return finish(0);
 }